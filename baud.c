@@ -0,0 +1,192 @@
+/******************************************************************************
+ * baud.c
+ *
+ * Description:
+ *
+ * Baud rate negotiation, see baud.h.  baudByte takes the request and the
+ * confirmation in one byte at a time; baudPoll, called on every pass of
+ * the main loop, makes the switch once the transmitter has drained and
+ * goes back when the confirmation does not come.
+ *
+ *****************************************************************************/
+
+// project includes
+#include "types.h"
+#include "sci.h"
+#include "upload.h"
+#include "baud.h"
+
+// Where the negotiation is.
+enum BAUDSTATE
+{
+  BAUD_IDLE = 0,                // BAUD_START
+  BAUD_HIGH,                    // the high byte of the rate
+  BAUD_LOW,                     // the low byte of the rate
+  BAUD_CHECKSUM,                // the checksum
+  BAUD_DRAINING,                // the ACK is on its way out at the old rate
+  BAUD_CONFIRMING               // switched, waiting for the host's ACK
+};
+
+static enum BAUDSTATE baudState = BAUD_IDLE;
+static UINT8 baudSeenTick = 0;     // tick baudPoll last looked at
+static UINT8 baudIdleTicks = 0;    // since the last byte, or the switch, stops at 255
+static UINT8 baudSum = 0;          // of every byte after BAUD_START
+static UINT16 baudRate = 0;        // hundreds of baud
+static UINT16 baudNewDivisor = 0;
+static UINT16 baudOldDivisor = 0;
+
+static void baudGiveUp(void);
+
+
+//*****************************************************************************
+// Tells whether a request has been started and not finished.
+//
+// Parameters: NONE
+//
+// Return: TRUE if the next byte received belongs to the negotiation.
+//*****************************************************************************
+UINT8 baudReceiving(void)
+{
+   return (baudState != BAUD_IDLE) ? TRUE : FALSE;
+}
+
+//*****************************************************************************
+// Takes the next byte of a request, or the confirmation.
+//
+// Parameters:  ch             The byte.  The first of a request must be
+//                             BAUD_START, anything else is ignored.
+//              now            The OC1 tick count.
+//
+// Return: None.
+//*****************************************************************************
+void baudByte(UINT8 ch, UINT8 now)
+{
+   baudSum = (UINT8)(baudSum + ch);
+
+   switch(baudState)
+   {
+      case BAUD_IDLE:
+         if(ch == BAUD_START)
+         {
+            baudSum = 0;
+            baudState = BAUD_HIGH;
+         }
+         break;
+
+      case BAUD_HIGH:
+         baudRate = (UINT16)(ch << 8);
+         baudState = BAUD_LOW;
+         break;
+
+      case BAUD_LOW:
+         baudRate |= ch;
+         baudState = BAUD_CHECKSUM;
+         break;
+
+      case BAUD_CHECKSUM:
+         baudNewDivisor = (baudSum == 0) ? SciDivisor((UINT32)baudRate * 100UL) : 0;
+         if(baudNewDivisor == 0)
+         {
+            baudState = BAUD_IDLE;
+            TERMIO_PutChar(UPLOAD_NAK);
+            break;
+         }
+         baudState = BAUD_DRAINING;
+         TERMIO_PutChar(UPLOAD_ACK);
+         break;
+
+      case BAUD_DRAINING:
+         // The host should be waiting for the ACK.
+         return;
+
+      default:
+         if(ch != UPLOAD_ACK)
+         {
+            baudGiveUp();
+            return;
+         }
+         baudState = BAUD_IDLE;
+         TERMIO_PutChar(UPLOAD_ACK);
+         return;
+   }
+
+   baudSeenTick = now;
+   baudIdleTicks = 0;
+}
+
+//*****************************************************************************
+// Moves the negotiation on without a byte coming in: switches the rate
+// once the ACK has gone out and gives up on a request or a confirmation
+// that has taken too long.
+//
+// Parameters:  now            The OC1 tick count.
+//
+// Return: None.
+//*****************************************************************************
+void baudPoll(UINT8 now)
+{
+   UINT8 elapsed = (UINT8)(now - baudSeenTick);
+
+   baudSeenTick = now;
+   if(baudState == BAUD_IDLE)
+   {
+      return;
+   }
+
+   baudIdleTicks = (elapsed > 0xFF - baudIdleTicks) ? 0xFF :
+                   (UINT8)(baudIdleTicks + elapsed);
+
+   switch(baudState)
+   {
+      case BAUD_IDLE:
+         break;
+
+      case BAUD_DRAINING:
+         if(TxDrained() == TRUE)
+         {
+            baudOldDivisor = sciBaudDivisor;
+            SetBaudDivisor(baudNewDivisor);
+            baudIdleTicks = 0;
+            baudState = BAUD_CONFIRMING;
+         }
+         break;
+
+      case BAUD_CONFIRMING:
+         if(baudIdleTicks > BAUD_CONFIRM_TICKS)
+         {
+            baudGiveUp();
+         }
+         break;
+
+      default:
+         if(baudIdleTicks > BAUD_TIMEOUT_TICKS)
+         {
+            baudState = BAUD_IDLE;
+            TERMIO_PutChar(UPLOAD_NAK);
+         }
+         break;
+   }
+}
+
+//*****************************************************************************
+// Tells whether the trace records must be kept off the line: from the
+// ACK of a request until the switch has been confirmed, the host may be
+// listening at either rate.  Only the main loop's traceFlush asks, see
+// baud.h for what else may still be sent.
+//
+// Parameters: NONE
+//
+// Return: TRUE while the trace records must be held back.
+//*****************************************************************************
+UINT8 baudHolding(void)
+{
+   return (baudState == BAUD_DRAINING || baudState == BAUD_CONFIRMING) ? TRUE : FALSE;
+}
+
+// Goes back to the old rate and says so at it.
+static void baudGiveUp(void)
+{
+   SetBaudDivisor(baudOldDivisor);
+   baudState = BAUD_IDLE;
+   TERMIO_PutChar(UPLOAD_NAK);
+}
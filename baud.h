@@ -0,0 +1,69 @@
+/******************************************************************************
+ * baud.h
+ *
+ * Description:
+ *
+ * Baud rate negotiation over SCI0.  The port comes up at SCI_BAUD; once
+ * connected a host can ask for a faster rate with
+ *
+ *    BAUD_START  rate high  rate low  checksum
+ *
+ * where rate is the baud rate in hundreds (1152 for 115200) and checksum
+ * makes the two rate bytes and itself add up to 0 modulo 256.  Then:
+ *
+ *  1. The firmware answers UPLOAD_NAK if it cannot keep to that rate at
+ *     its bus clock (see SciDivisor), and that is the end of it.
+ *     Otherwise it answers UPLOAD_ACK, still at the old rate, and
+ *     switches once the ACK has left the line.
+ *  2. The host switches on seeing the ACK, waits BAUD_SETTLE_TICKS so
+ *     the firmware has switched too, and sends UPLOAD_ACK at the new
+ *     rate.
+ *  3. The firmware answers that with UPLOAD_ACK at the new rate and goes
+ *     on at it.  If anything else comes in, or nothing does within
+ *     BAUD_CONFIRM_TICKS of switching, it goes back to the old rate and
+ *     answers UPLOAD_NAK at that.
+ *
+ * So a line that cannot carry the new rate always ends up back where it
+ * was, and a host finds the fastest rate that works by asking for the
+ * rates it can do from the top down.  The rate lasts until reset.
+ *
+ * From the ACK in 1 until 3 is over baudHolding is TRUE and the main
+ * loop sends no trace records.  Nothing else is held.  Every byte
+ * received then is taken as part of the negotiation, so there are no
+ * prompts or answers to uploads and command lines, but the error message
+ * of a recipe that fails still goes out, at whichever rate the port is
+ * at, and the host may not be listening at it.  A host that has to see
+ * those asks for a rate while no recipe is running.
+ *
+ * BAUD_START is a control character no operator command uses, so
+ * getUserInput can tell a request from keys by its first byte.  A
+ * request that stops for longer than BAUD_TIMEOUT_TICKS is dropped with
+ * an UPLOAD_NAK.
+ *
+ *****************************************************************************/
+
+#ifndef BAUD_H
+#define BAUD_H
+
+#include "types.h"
+
+#define BAUD_START           0x05   // ASCII ENQ
+
+// Longest gap, in OC1 ticks, between two bytes of a request.
+#define BAUD_TIMEOUT_TICKS   10
+
+// How long the host waits after the first UPLOAD_ACK before it confirms
+// at the new rate, in OC1 ticks.  The firmware switches in the first
+// pass of the main loop after the ACK is out, within a tick.
+#define BAUD_SETTLE_TICKS    2
+
+// How long the firmware waits for the confirmation at the new rate
+// before it goes back, in OC1 ticks.
+#define BAUD_CONFIRM_TICKS   20
+
+UINT8 baudReceiving(void);
+void baudByte(UINT8 ch, UINT8 now);
+void baudPoll(UINT8 now);
+UINT8 baudHolding(void);
+
+#endif // BAUD_H
@@ -0,0 +1,108 @@
+/******************************************************************************
+ * clock.h
+ *
+ * Description:
+ *
+ * The one clock definition everything that counts bus cycles is worked
+ * out from.  halClockInit sets the PLL up to run the bus at BUS_CLK_FREQ,
+ * and the timer prescaler and OC1 period (main.c), the PWM clocks and
+ * period (hal_hcs12.c) and the SCI0 baud divisors (sci.h) are derived
+ * from it at compile time.  The STATIC_ASSERTs at the bottom stop the
+ * build if a clock is changed to one they cannot be derived for, instead
+ * of leaving a wrong divider to be found on the bench.
+ *
+ * The bus runs at half of PLLCLK:
+ *
+ *    BUS_CLK_FREQ = OSC_CLK_FREQ * (PLL_SYNR + 1) / (PLL_REFDV + 1)
+ *
+ * The HCS12 is rated for a 25 MHz bus.  24 MHz is the fastest the 4 MHz
+ * crystal gives that still has a timer prescaler landing on a whole
+ * number of counts per millisecond and 115200 baud within 0.2%; at
+ * 25 MHz it would be 3% off.  Build with PLL_OFF to leave the PLL off
+ * and run the bus from the crystal at OSC_CLK_FREQ / 2, 2 MHz, as the
+ * board used to.
+ *
+ *****************************************************************************/
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "types.h"
+
+// Crystal on the board in Hz.
+#define OSC_CLK_FREQ       ((UINT32) 4000000)
+
+// Fastest bus the HCS12 is rated for in Hz.
+#define BUS_CLK_FREQ_MAX   ((UINT32) 25000000)
+
+#ifndef PLL_OFF
+
+// PLL multiplier and reference divider, the SYNR and REFDV values.
+#define PLL_SYNR           5
+#define PLL_REFDV          0
+
+// Bus clock of the board in Hz.
+#define BUS_CLK_FREQ       ((UINT32)(OSC_CLK_FREQ * (PLL_SYNR + 1) / (PLL_REFDV + 1)))
+
+#else
+
+#define BUS_CLK_FREQ       ((UINT32)(OSC_CLK_FREQ / 2))
+
+#endif // PLL_OFF
+
+// The timer counts the bus clock divided by 2 to the power
+// TIMER_PRESCALE_SHIFT, the TSCR2 PR bits.  The smallest prescaler that
+// keeps it at or below 1 MHz, so a 50 ms tick still fits the 16 bit
+// output compares.
+#define TIMER_PRESCALE_SHIFT  (BUS_CLK_FREQ <=  1000000UL ? 0 : \
+                               BUS_CLK_FREQ <=  2000000UL ? 1 : \
+                               BUS_CLK_FREQ <=  4000000UL ? 2 : \
+                               BUS_CLK_FREQ <=  8000000UL ? 3 : \
+                               BUS_CLK_FREQ <= 16000000UL ? 4 : \
+                               BUS_CLK_FREQ <= 32000000UL ? 5 : 6)
+#define TIMER_CLK_FREQ        (BUS_CLK_FREQ >> TIMER_PRESCALE_SHIFT)
+#define TIMER_COUNTS_PER_MS   (TIMER_CLK_FREQ / 1000UL)
+
+// The servo PWM channels count the scaled clocks SA and SB at
+// PWM_CLK_FREQ; servoPositionTicks in recipe.c are in its units, 80 us.
+// Clocks A and B are the bus clock divided by 2 to the power
+// PWM_PRESCALE_SHIFT and SA and SB divide them by 2 * PWM_SCALE more.
+// A period of PWM_PERIOD_TICKS gives the 20 ms frame the servos expect.
+#define PWM_CLK_FREQ          12500UL
+#define PWM_PRESCALE_SHIFT    4
+#define PWM_SCALE             ((BUS_CLK_FREQ >> PWM_PRESCALE_SHIFT) / (2UL * PWM_CLK_FREQ))
+#define PWM_PERIOD_TICKS      (PWM_CLK_FREQ / 50UL)
+
+// Built with PWM_16BIT the channels are concatenated in pairs, 01, 23, 45
+// and 67, for a servo on each.  They count clocks A and B themselves, set
+// by the smallest prescaler that still fits the 20 ms frame in their 16
+// bit period, PWM16_PERIOD_TICKS.  A servo duty then has PWM_DUTY_SCALE
+// steps to one PWM_CLK_FREQ tick instead of one.
+#define PWM16_PRESCALE_SHIFT  ((BUS_CLK_FREQ >> 0) / 50UL <= 0xFFFFUL ? 0 : \
+                               (BUS_CLK_FREQ >> 1) / 50UL <= 0xFFFFUL ? 1 : \
+                               (BUS_CLK_FREQ >> 2) / 50UL <= 0xFFFFUL ? 2 : \
+                               (BUS_CLK_FREQ >> 3) / 50UL <= 0xFFFFUL ? 3 : 4)
+#define PWM16_CLK_FREQ        (BUS_CLK_FREQ >> PWM16_PRESCALE_SHIFT)
+#define PWM16_PERIOD_TICKS    (PWM16_CLK_FREQ / 50UL)
+
+#ifdef PWM_16BIT
+#define PWM_DUTY_SCALE        (PWM16_CLK_FREQ / PWM_CLK_FREQ)
+#else
+#define PWM_DUTY_SCALE        1UL
+#endif
+
+#ifndef PLL_OFF
+STATIC_ASSERT(pllSynrFits, PLL_SYNR >= 0 && PLL_SYNR <= 63);
+STATIC_ASSERT(pllRefdvFits, PLL_REFDV >= 0 && PLL_REFDV <= 15);
+#endif
+STATIC_ASSERT(busWithinRating, BUS_CLK_FREQ <= BUS_CLK_FREQ_MAX);
+STATIC_ASSERT(timerCountsWholeMs, TIMER_CLK_FREQ % 1000UL == 0);
+STATIC_ASSERT(pwmClockExact, PWM_SCALE * 2UL * PWM_CLK_FREQ << PWM_PRESCALE_SHIFT == BUS_CLK_FREQ);
+STATIC_ASSERT(pwmScaleFits, PWM_SCALE >= 1 && PWM_SCALE <= 256);
+STATIC_ASSERT(pwmPeriodFits, PWM_PERIOD_TICKS <= 255);
+#ifdef PWM_16BIT
+STATIC_ASSERT(pwm16ClockExact, PWM16_CLK_FREQ % PWM_CLK_FREQ == 0);
+STATIC_ASSERT(pwm16PeriodFits, PWM16_PERIOD_TICKS <= 0xFFFFUL);
+#endif
+
+#endif // CLOCK_H
@@ -0,0 +1,190 @@
+/******************************************************************************
+ * cmdline.c
+ *
+ * Description:
+ *
+ * Operator command line parser, see cmdline.h.  lineChar takes the line
+ * in one character at a time and parses it as it comes, so no more than
+ * the commands themselves are kept.  What to do with a good line is up
+ * to the caller.
+ *
+ *****************************************************************************/
+
+// project includes
+#include "types.h"
+#include "sci.h"
+#include "upload.h"
+#include "cmdline.h"
+
+// What the next character of a line can be.
+enum LINESTATE
+{
+  LINE_IDLE = 0,                // LINE_START
+  LINE_SERVO,                   // a servo letter, a space or the end
+  LINE_COLON,                   // the colon after the servo letter
+  LINE_KEY,                     // the key after the colon
+  LINE_SPACE,                   // a space or the end
+  LINE_SKIP                     // anything up to the end, the line is bad
+};
+
+UINT8 lineCount = 0;
+UINT8 lineServos[LINE_MAX_COMMANDS];
+UINT8 lineKeys[LINE_MAX_COMMANDS];
+
+static enum LINESTATE lineState = LINE_IDLE;
+static UINT8 lineSeenTick = 0;     // tick count linePoll or lineChar last saw
+static UINT8 lineIdleTicks = 0;    // ticks since the last character, up to 0xFF
+
+static UINT8 isLineEnd(UINT8 ch);
+static UINT8 isOperatorKey(UINT8 ch);
+
+
+//*****************************************************************************
+// Tells whether a line has been started and not finished.
+//
+// Parameters: NONE
+//
+// Return: TRUE if the next character received belongs to a line.
+//*****************************************************************************
+UINT8 lineReceiving(void)
+{
+   return (lineState != LINE_IDLE) ? TRUE : FALSE;
+}
+
+//*****************************************************************************
+// Gives up on a line that has had no character for more than
+// LINE_TIMEOUT_TICKS and answers it with UPLOAD_NAK, the same way
+// uploadPoll does for a frame.
+//
+// Parameters:  now            The OC1 tick count.
+//
+// Return: None.
+//*****************************************************************************
+void linePoll(UINT8 now)
+{
+   UINT8 elapsed = (UINT8)(now - lineSeenTick);
+
+   lineSeenTick = now;
+   if(lineState == LINE_IDLE)
+   {
+      return;
+   }
+
+   lineIdleTicks = (elapsed > 0xFF - lineIdleTicks) ? 0xFF :
+                   (UINT8)(lineIdleTicks + elapsed);
+   if(lineIdleTicks > LINE_TIMEOUT_TICKS)
+   {
+      lineState = LINE_IDLE;
+      TERMIO_PutChar(UPLOAD_NAK);
+   }
+}
+
+//*****************************************************************************
+// Takes the next character of a line.
+//
+// Parameters:  ch             The character.  The first of a line must be
+//                             LINE_START, anything else is ignored.
+//              now            The OC1 tick count.
+//
+// Return: LINE_DONE at the end of a line that was understood, LINE_BAD
+//         at the end of one that was not, otherwise LINE_MORE.
+//*****************************************************************************
+enum LINERESULT lineChar(UINT8 ch, UINT8 now)
+{
+   lineSeenTick = now;
+   lineIdleTicks = 0;
+
+   if(lineState != LINE_IDLE && isLineEnd(ch) == TRUE)
+   {
+      if(lineState == LINE_SERVO || lineState == LINE_SPACE)
+      {
+         lineState = LINE_IDLE;
+         return LINE_DONE;
+      }
+      lineState = LINE_IDLE;
+      return LINE_BAD;
+   }
+
+   switch(lineState)
+   {
+      case LINE_IDLE:
+         if(ch == LINE_START)
+         {
+            lineCount = 0;
+            lineState = LINE_SERVO;
+         }
+         break;
+
+      case LINE_SERVO:
+         if(ch == ' ')
+         {
+            break;
+         }
+         if(ch >= 'a' && ch <= 'z')
+         {
+            ch = (UINT8)(ch - 'a' + 'A');
+         }
+         if(ch < 'A' || ch > 'Z' || lineCount == LINE_MAX_COMMANDS)
+         {
+            lineState = LINE_SKIP;
+            break;
+         }
+         lineServos[lineCount] = (UINT8)(ch - 'A');
+         lineState = LINE_COLON;
+         break;
+
+      case LINE_COLON:
+         lineState = (ch == ':') ? LINE_KEY : LINE_SKIP;
+         break;
+
+      case LINE_KEY:
+         if(isOperatorKey(ch) == FALSE)
+         {
+            lineState = LINE_SKIP;
+            break;
+         }
+         lineKeys[lineCount] = ch;
+         lineCount++;
+         lineState = LINE_SPACE;
+         break;
+
+      case LINE_SPACE:
+         lineState = (ch == ' ') ? LINE_SERVO : LINE_SKIP;
+         break;
+
+      default:
+         break;
+   }
+
+   return LINE_MORE;
+}
+
+// TRUE for the CR or LF that ends a line.
+static UINT8 isLineEnd(UINT8 ch)
+{
+   return (ch == '\r' || ch == '\n') ? TRUE : FALSE;
+}
+
+// TRUE for a key processServoInput knows.
+static UINT8 isOperatorKey(UINT8 ch)
+{
+   if(ch >= 'A' && ch <= 'Z')
+   {
+      ch = (UINT8)(ch - 'A' + 'a');
+   }
+
+   switch(ch)
+   {
+      case 'c':
+      case 'p':
+      case 'b':
+      case 'n':
+      case 'r':
+      case 'l':
+      case 's':
+         return TRUE;
+
+      default:
+         return FALSE;
+   }
+}
@@ -0,0 +1,59 @@
+/******************************************************************************
+ * cmdline.h
+ *
+ * Description:
+ *
+ * Operator command lines over SCI0, for scripts.  Where a person at the
+ * terminal types one key for each servo in turn, a script sends any
+ * number of commands for any servos as one line:
+ *
+ *    LINE_START  A:p B:r A:c  CR or LF
+ *
+ * Each command is a servo letter, a colon and one of the operator keys
+ * (c, p, b, n, r, l or s, either case), and they are separated by
+ * spaces.  Nothing is echoed and no prompt is printed; once the whole
+ * line is in the firmware carries out every command on it, in order, in
+ * the same pass of the main loop and answers with one UPLOAD_ACK, or
+ * with one UPLOAD_NAK, carrying out none of them, if the line is not
+ * understood or names a servo there is not.
+ *
+ * LINE_START is a character no operator command uses, so getUserInput
+ * can tell a line from keys by its first character.  A line that runs
+ * past LINE_MAX_COMMANDS is dropped with an UPLOAD_NAK, and so is one
+ * that stops for longer than LINE_TIMEOUT_TICKS, by linePoll, called on
+ * every pass of the main loop, and the keys after it are keys again.
+ *
+ *****************************************************************************/
+
+#ifndef CMDLINE_H
+#define CMDLINE_H
+
+#include "types.h"
+
+#define LINE_START           '>'
+
+// Most commands on one line.
+#define LINE_MAX_COMMANDS    16
+
+// Longest gap, in OC1 ticks, between two characters of a line.
+#define LINE_TIMEOUT_TICKS   10
+
+// What lineChar made of a character.
+enum LINERESULT
+{
+  LINE_MORE = 0,                // part of a line, more to come
+  LINE_DONE,                    // the end of a good line
+  LINE_BAD                      // the end of a line that was not understood
+};
+
+// The commands of the last good line, valid once lineChar returns
+// LINE_DONE.  lineServos are 0 for servo A, 1 for B and so on.
+extern UINT8 lineCount;
+extern UINT8 lineServos[LINE_MAX_COMMANDS];
+extern UINT8 lineKeys[LINE_MAX_COMMANDS];
+
+UINT8 lineReceiving(void);
+void linePoll(UINT8 now);
+enum LINERESULT lineChar(UINT8 ch, UINT8 now);
+
+#endif // CMDLINE_H
@@ -0,0 +1,105 @@
+/******************************************************************************
+ * hal.h
+ *
+ * Description:
+ *
+ * Thin hardware abstraction layer for the PWM, status LED, timer and SCI0
+ * peripherals used by main.c.
+ *
+ * On the HCS12 the run time accessors are macros straight onto the
+ * derivative.h registers so they cost exactly what the register access did
+ * before.  The one time peripheral setup lives in hal_hcs12.c.
+ *
+ * When HOST_SIM is defined the same names are implemented by the Linux
+ * simulation backend in sim/hal_sim.c, which models the registers in memory
+ * and drives the interrupt service routines from a virtual clock.
+ *
+ *****************************************************************************/
+
+#ifndef HAL_H
+#define HAL_H
+
+#include "types.h"
+
+// Starts the PLL and runs the bus from it at BUS_CLK_FREQ (clock.h).
+// Call it first, everything else is set up for that clock.
+void halClockInit(void);
+
+// Initializes the PWM clocks, period and polarity for the servo channels,
+// and with PWM_16BIT concatenates them in pairs.
+void halPwmInit(void);
+
+// Initializes the timer to TIMER_CLK_FREQ and enables Output Compare Channel 1
+// with its first compare at firstCompare.  Channels 2 to 7 are set up as
+// output compares for the servo deadlines with their interrupts off.
+void halTimerInit(UINT16 firstCompare);
+
+// Initializes SCI0 for 8N1 with the given SCI0BD divisor.
+void halSciInit(UINT16 baudDivisor);
+
+// Configures PORTA as the status LED output port.
+void halLedInit(void);
+
+#ifdef HOST_SIM
+
+#include "sim/hal_sim.h"
+
+#else
+
+#include <hidef.h>      /* common defines and macros */
+#include "derivative.h" /* derivative-specific definitions */
+
+// Interrupt service routine declaration.
+#define HAL_ISR(vector, name)        void interrupt vector name(void)
+
+// PWM channels.  PWMDTY0..PWMDTY7 are consecutive registers.
+#define halPwmGetEnable()            (PWME)
+#define halPwmSetEnable(mask)        (PWME = (mask))
+#define halPwmSetDuty(channel, duty) ((&PWMDTY0)[(channel)] = (duty))
+
+// Concatenated PWM channels, PWM_16BIT.  PWMDTY01..PWMDTY67 are
+// consecutive 16 bit registers; channel is the odd one of the pair.
+#define halPwmSetDuty16(channel, duty) ((&PWMDTY01)[(channel) >> 1] = (duty))
+
+// Status LEDs.
+#define halLedGet()                  (PORTA)
+#define halLedPut(value)             (PORTA = (value))
+
+// Output Compare Channel 1.
+#define halTimerAcknowledge(period)  (TC1 += (period), TFLG1 = TFLG1_C1F_MASK)
+
+// Output compare channels used for deadlines.  TC0..TC7 are consecutive
+// registers.  Only change TIE with interrupts disabled, the ISRs change
+// it too.
+#define halTimerNow()                          (TCNT)
+#define halTimerGetCompare(channel)            ((&TC0)[(channel)])
+#define halTimerSetCompare(channel, value)     ((&TC0)[(channel)] = (value))
+#define halTimerCompareFlag(channel)           (TFLG1 & (UINT8)(1 << (channel)))
+#define halTimerCompareAcknowledge(channel)    (TFLG1 = (UINT8)(1 << (channel)))
+#define halTimerCompareIntEnable(channel)      (TIE |= (UINT8)(1 << (channel)))
+#define halTimerCompareIntDisable(channel)     (TIE &= (UINT8)~(1 << (channel)))
+
+// SCI0.
+#define halSciSetDivisor(divisor)    (SCI0BD = (divisor))
+#define halSciTxComplete()           (SCI0SR1_TC)
+#define halSciTxEmpty()              (SCI0SR1_TDRE)
+#define halSciTxIntEnable()          (SCI0CR2_SCTIE = 1)
+#define halSciTxIntDisable()         (SCI0CR2_SCTIE = 0)
+#define halSciWrite(ch)              (SCI0DRL = (ch))
+#define halSciRxFull()               (SCI0SR1_RDRF)
+#define halSciRxOverrun()            (SCI0SR1_OR)
+#define halSciRxIntEnable()          (SCI0CR2_RIE = 1)
+#define halSciRead()                 (SCI0DRL)
+
+#define halEnableInterrupts()        EnableInterrupts
+#define halDisableInterrupts()       DisableInterrupts
+
+// Enables interrupts and stops the CPU until one is taken.  Call it with
+// interrupts disabled: the CPU holds off interrupts for one instruction
+// after CLI, so one that arrives after the caller's last check still
+// wakes the WAI instead of slipping in before it.
+#define halWaitForInterrupt()        {__asm CLI; __asm WAI;}
+
+#endif // HOST_SIM
+
+#endif // HAL_H
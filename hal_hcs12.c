@@ -0,0 +1,138 @@
+/******************************************************************************
+ * hal_hcs12.c
+ *
+ * Description:
+ *
+ * HCS12 backend of the hardware abstraction layer.  Only the one time
+ * peripheral setup lives here, the run time register accessors are the
+ * macros in hal.h.
+ *
+ *****************************************************************************/
+
+// project includes
+#include "types.h"
+#include "clock.h"
+#include "hal.h"
+
+// Starts the PLL at PLL_SYNR and PLL_REFDV and switches the bus over
+// to it once it has locked.  With PLL_OFF the bus stays on the crystal.
+//--------------------------------------------------------------
+void halClockInit(void)
+{
+#ifndef PLL_OFF
+  CLKSEL_PLLSEL = 0;  // Run from the crystal while the PLL is changed.
+  PLLCTL_PLLON = 1;
+  SYNR  = PLL_SYNR;
+  REFDV = PLL_REFDV;
+
+  while(CRGFLG_LOCK == 0)
+  {
+    // Nothing
+  }
+
+  CLKSEL_PLLSEL = 1;  // Bus clock = PLLCLK / 2 = BUS_CLK_FREQ.
+#endif
+}
+
+// Sets up the PWM clocks for the servo channels.
+//--------------------------------------------------------------
+void halPwmInit(void)
+{
+  UINT8 channel;
+
+  PWME   = 0x00; // Disable All servos
+  PWMCAE = 0x00; // Set the outputs for all PWMs to left aligned
+  PWMPOL = 0xFF; // Set the pulse Width Polarity of all channels to high.
+
+#ifndef PWM_16BIT
+  // Set clocks A and B to bus clock / (1 << PWM_PRESCALE_SHIFT) and
+  // Clock SA = Clock A / (2 * PWMSCLA) = PWM_CLK_FREQ, the same for SB.
+  PWMPRCLK = (UINT8)((PWM_PRESCALE_SHIFT << 4) | PWM_PRESCALE_SHIFT);
+  PWMSCLA  = (UINT8)PWM_SCALE;   // 256 is written as 0
+  PWMSCLB  = (UINT8)PWM_SCALE;
+  PWMCLK = 0xFF; // select Scaled Clock A (SA) for PWM channels 0, 1, 4
+                 // and 5 and Scaled Clock B (SB) for channels 2, 3, 6
+                 // and 7
+  PWMCTL = 0x00; // set everthing in the PWMCTL registers to 0 to
+                 // provide a baseline.
+
+  // A 20 ms frame on every channel.  PWMPER0..PWMPER7 are consecutive
+  // registers.
+  for(channel = 0; channel < 8; channel++)
+  {
+    (&PWMPER0)[channel] = (UINT8)PWM_PERIOD_TICKS;
+  }
+#else
+  // Set clocks A and B to bus clock / (1 << PWM16_PRESCALE_SHIFT) =
+  // PWM16_CLK_FREQ and use them unscaled on every channel.
+  PWMPRCLK = (UINT8)((PWM16_PRESCALE_SHIFT << 4) | PWM16_PRESCALE_SHIFT);
+  PWMCLK = 0x00;
+  PWMCTL = 0xF0; // CON67, CON45, CON23 and CON01: four 16 bit channels,
+                 // each driven through the clock select, polarity,
+                 // enable and output of its odd channel.
+
+  // A 20 ms frame on every pair.  PWMPER01..PWMPER67 are consecutive
+  // 16 bit registers.
+  for(channel = 0; channel < 4; channel++)
+  {
+    (&PWMPER01)[channel] = (UINT16)PWM16_PERIOD_TICKS;
+  }
+#endif
+}
+
+// Sets up the timer for a TIMER_CLK_FREQ count and Output Compare
+// Channel 1, and channels 2 to 7 as output compares for the servo
+// deadlines.
+//--------------------------------------------------------------
+void halTimerInit(UINT16 firstCompare)
+{
+  // Set the timer prescaler to 1 << TIMER_PRESCALE_SHIFT, 32 for the
+  // 24 MHz bus clock, so the timer runs at TIMER_CLK_FREQ
+  TSCR2_PR0 = (TIMER_PRESCALE_SHIFT >> 0) & 1;
+  TSCR2_PR1 = (TIMER_PRESCALE_SHIFT >> 1) & 1;
+  TSCR2_PR2 = (TIMER_PRESCALE_SHIFT >> 2) & 1;
+
+  // Enable output compare on Channel 1
+  TIOS_IOS1 = 1;
+
+  // Channels 2 to 7 are output compares with no pin action (TCTL1 and
+  // TCTL2 reset to 0) and their interrupts off until a deadline is set.
+  TIOS |= 0xFC;
+
+  // Set up output compare action to toggle Port T, bit 1
+  TCTL2_OM1 = 0;
+  TCTL2_OL1 = 1;
+
+  // Set up timer compare value
+  TC1 = firstCompare;
+
+  // Clear the Output Compare Interrupt Flag (Channel 1)
+  TFLG1 = TFLG1_C1F_MASK;
+
+  // Enable the output compare interrupt on Channel 1;
+  TIE_C1I = 1;
+
+  //
+  // Enable the timer
+  //
+  TSCR1_TEN = 1;
+}
+
+// Sets up SCI0 for 8N1 with the given baud divisor.
+//--------------------------------------------------------------
+void halSciInit(UINT16 baudDivisor)
+{
+    SCI0BD = baudDivisor;
+
+    // 8N1 is default, so we don't have to touch SCI0CR1.
+    // Enable the transmitter and receiver.
+    SCI0CR2_TE = 1;
+    SCI0CR2_RE = 1;
+}
+
+// Sets up PORTA for the status LEDs.
+//--------------------------------------------------------------
+void halLedInit(void)
+{
+  DDRA = 0xFF;
+}
@@ -3,7 +3,7 @@
  *
  * Description:
  *
- * This demo configures the timer to a rate of 1 MHz, and the Output Compare
+ * This demo configures the timer to a rate of TIMER_CLK_FREQ, and the Output Compare
  * Channel 1 to toggle PORT T, Bit 1 at rate of 10 Hz. 
  *
  * The toggling of the PORT T, Bit 1 output is done via the Compare Result Output
@@ -19,13 +19,16 @@
  *****************************************************************************/
 
 
-// system includes
-#include <hidef.h>      /* common defines and macros */
-#include <stdio.h>      /* Standard I/O Library */
-
 // project includes
 #include "types.h"
-#include "derivative.h" /* derivative-specific definitions */
+#include "clock.h"      /* bus clock */
+#include "hal.h"        /* hardware abstraction layer */
+#include "sci.h"        /* SCI0 terminal driver */
+#include "recipe.h"     /* recipe interpreter */
+#include "trace.h"      /* binary event trace */
+#include "upload.h"     /* recipe upload frames */
+#include "cmdline.h"    /* operator command lines */
+#include "baud.h"       /* baud rate negotiation */
 
 // Definitions
 
@@ -39,110 +42,107 @@
 // TC1_VAL = ((Bus Clock Frequency / Prescaler value) / 2) / Desired Freq in Hz
 //
 // Where:
-//        Bus Clock Frequency     = 2 MHz
-//        Prescaler Value         = 2 (Effectively giving us a 1 MHz timer)
+//        Bus Clock Frequency     = BUS_CLK_FREQ (clock.h), 24 MHz
+//        Prescaler Value         = 1 << TIMER_PRESCALE_SHIFT (clock.h), 32,
+//                                  giving us a 750 kHz timer (TIMER_CLK_FREQ)
 //        2 --> Since we want to toggle the output at half of the period
 //        Desired Frequency in Hz = The value you put in OC_FREQ_HZ
 //
-#define BUS_CLK_FREQ  ((UINT32) 2000000)   
-#define PRESCALE      ((UINT16)  2)         
-#define TC1_VAL       ((UINT16)  (((BUS_CLK_FREQ / PRESCALE) / 2) / OC_FREQ_HZ))
-
-// Define some booleans for code readability.
-#define TRUE 1
-#define FALSE 0
-
-// These are used to hold the user input.
-UINT8 servo1UserInput = 0;
-UINT8 servo2UserInput = 0;
-
-// These are used to extract the command and
-// any parameters attached to those commands.
-#define firstThree(x) ((x>>5)<<5)
-#define lastFive(y) (y&31)
-
-// These are the basic PWMPER values
-// They vary depending on where the positions 
-// are marked on the boxes.  1 tick = ~ 10 degrees.
-// TODO.  Needs some tuning. 
-//POS0_TICKS   0x05
-//POS1_TICKS   0X09
-//POS2_TICKS   0X0C
-//POS3_TICKS   0X0F
-//POS4_TICKS   0X14
-//POS5_TICKS   0X18
-const UINT8 servoPositionTicks[6] = {0x05, 0X09, 0X0C, 0X0F, 0X14, 0X18};  
-  
-// buffers to hold the recipies for each servo.
-UINT8 bufferServoA[100] = {0};  // Commands buffer for ServoA
-UINT8 bufferServoB[100] = {0};  // Commands buffer for ServoB
+#define TC1_VAL       ((UINT16)  ((TIMER_CLK_FREQ / 2) / OC_FREQ_HZ))
 
-// Possible Task Statuses.
-enum TASKSTATUS
-{
-  ready = 0,
-  running,
-  error,
-  paused,
-  donothing,
-};
+// recipe.c takes a tick to be 50 ms, and the period has to fit TC1.
+STATIC_ASSERT(tickIs50ms, (TIMER_CLK_FREQ / 2) % OC_FREQ_HZ == 0 && OC_FREQ_HZ == 10);
+STATIC_ASSERT(tickFitsTC1, (TIMER_CLK_FREQ / 2) / OC_FREQ_HZ <= 0xFFFFUL);
+
+
+// OC1_isr only counts ticks and flags that there is work to do.  The
+// main loop runs the tasks once for every tick counted so a slow pass
+// (a printf at 9600 baud) delays the servos but never loses time.
+volatile UINT8 tickCount = 0;
+volatile UINT8 tasksPending = FALSE;
+UINT8 ticksRun = 0;
+
+// Number of servos the tasks are run for, servos[0] to
+// servos[servoCount - 1], every one the board has.  Only the first two
+// have recipes built in and take operator keys, the rest, there for
+// fixtures with more actuators, get their recipes by upload and their
+// commands by command line.
+UINT8 servoCount = SERVO_COUNT;
+
+// buffers to hold the recipies for each servo, two each: the one the
+// servo is running and one for changeRecipe to put the next one in.
+UINT8 bufferServo[SERVO_COUNT][2][RECIPE_SIZE] = {0};
 
-// the order of these commands match the op codes 
-// listed in the assignment.
-enum COMMANDS
+// Decoded recipes for each servo, one for each buffer.
+struct Instruction programServo[SERVO_COUNT][2][RECIPE_SIZE];
+
+// The subroutines any servo's recipe can CALL, and their decoded form.
+UINT8 bufferCommon[RECIPE_SIZE] = {0};
+struct Instruction programCommon[RECIPE_SIZE];
+
+// TRUE while runCommandLine carries out a line, which gets no help text.
+static UINT8 lineRunning = FALSE;
+
+// Look Ma TCBS!!!
+struct TaskControlBlock servos[SERVO_COUNT];
+
+// The PWM channel, output compare channel and status LEDs of each servo.
+// TC0 and TC1 are taken, so the last two servos count down on the tick.
+// PORTA only has room for the LEDs of the first two.
+#ifndef PWM_16BIT
+const struct ServoChannel servoChannels[SERVO_COUNT] =
 {
-  RECIPE_END = 0,
-  MOV = 32,
-  WAIT = 64,
-  TBD1,
-  LOOP_START = 128,
-  END_LOOP = 160,
-  BREAK_LOOP = 96,
-  TBD3
+   {0, 0x01, 2, 0x10, 0x20, 0x40, 0x80, 'A'},
+   {1, 0x02, 3, 0x01, 0x02, 0x04, 0x08, 'B'},
+   {2, 0x04, 4, 0x00, 0x00, 0x00, 0x00, 'C'},
+   {3, 0x08, 5, 0x00, 0x00, 0x00, 0x00, 'D'},
+   {4, 0x10, 6, 0x00, 0x00, 0x00, 0x00, 'E'},
+   {5, 0x20, 7, 0x00, 0x00, 0x00, 0x00, 'F'},
+   {6, 0x40, NO_TIMER_CHANNEL, 0x00, 0x00, 0x00, 0x00, 'G'},
+   {7, 0x80, NO_TIMER_CHANNEL, 0x00, 0x00, 0x00, 0x00, 'H'}
 };
-
-// Holds the information for each task.
-struct TaskControlBlock 
+#else
+// With PWM_16BIT a servo drives a concatenated pair through its odd
+// channel, and all four have an output compare channel.
+const struct ServoChannel servoChannels[SERVO_COUNT] =
 {
-   enum TASKSTATUS status;    
-   UINT8 * currentCommand;      // points to the current command in a bufferServo
-   
-   // Loop bookkeeping stuff.
-   UINT8 loopFlag;              // True if we're in a loop, otherwise false.
-   UINT8 loopCounter;           // Loop will run n+1 times.
-   UINT8* firstLoopInstruction; // Pointer to the instructon after the LOOP_START command.
-   
-   // MOV bookkeeping stuff
-   UINT8 currentServoPosition;  // 0-5
-   UINT8 expectedServoPosition; // 0-5
-   
-   // MOV and WAIT bookkeeping stuff
-   INT16 timeLeftms;            // timeleft to execute the current
-                                // command.
+   {1, 0x02, 2, 0x10, 0x20, 0x40, 0x80, 'A'},
+   {3, 0x08, 3, 0x01, 0x02, 0x04, 0x08, 'B'},
+   {5, 0x20, 4, 0x00, 0x00, 0x00, 0x00, 'C'},
+   {7, 0x80, 5, 0x00, 0x00, 0x00, 0x00, 'D'}
 };
+#endif
 
-// Look Ma TCBS!!!
-struct TaskControlBlock servoA;
-struct TaskControlBlock servoB;
+// One bit per servo, set by its output compare interrupt when the
+// deadline of its MOV or WAIT has passed.
+volatile UINT8 deadlinesExpired = 0;
 
 // Function definitions
-UINT8 GetChar(void);
 void getUserInput(void);
+void installRecipe(void);
+void runCommandLine(void);
+UINT8 changeRecipe(UINT8 index, const UINT8* recipe, UINT8 length);
+const UINT8* runningRecipe(UINT8 index);
 void initializeServos(void);
 void initializeCommands(void);
-void processCommand(struct TaskControlBlock* servo, enum COMMANDS command, UINT8 commandContext);
-void processUserCommand(void);
+void processServoInput(struct TaskControlBlock* servo, UINT8 input, struct TaskControlBlock* other);
+static UINT8 applyServoInput(struct TaskControlBlock* servo, UINT8 input, struct TaskControlBlock* other);
+static void keyMove(struct TaskControlBlock* servo, UINT8 position);
 void runTasks(void);
-void updateTaskStatus(struct TaskControlBlock* servo);
-
-// Flags to show the reciepe end.
-UINT8 reciepeEndServoA =0;
-UINT8 reciepeEndServoB =0;
+void runDeadlines(void);
+void dispatchTasks(void);
 
 
 //*****************************************************************************
 // This unmitigated piece of crap will get user input from the keyboard for each
-// servo and assign the values to global variables for processing. 
+// servo and carry it out.  The keys go to the first and the second servo
+// in turn.
+// It never waits for a key, it takes everything SCI0_isr has queued, in
+// the order it came in, and returns so the main loop can keep dispatching
+// the tasks.  Each key is carried out as soon as it is taken, the first
+// servo's does not wait for the second's.  A recipe upload frame, a
+// command line or a baud rate request is taken in straight away, byte by
+// byte, and never seen as keys.
 //
 // Parameters: NONE
 //
@@ -150,205 +150,306 @@ UINT8 reciepeEndServoB =0;
 //*****************************************************************************
 void getUserInput(void) 
 {
-   UINT8 buffer [3];
-   INT8 bufferIndex = 0;
-   UINT8 carriageRet = '\r';
-   UINT16 value = 0;
+   static UINT8 buffer [3];
+   static INT8 bufferIndex = -1;   // -1 until the first prompt is shown.
+   UINT8 ch;
+   
+   if(bufferIndex < 0) 
+   {
+      PutString("\n\rCommand for first Servo: ");
+      bufferIndex = 0;
+   }
    
-   // Read the digits into a buffer until you get a carage return.
-   // Fetch and echo the user input
-   printf("\n\rCommand for first Servo: ");
-   buffer[bufferIndex] = GetChar();
-   bufferIndex++;
-   printf("\n\rCommand for second Servo: ");
-   buffer[bufferIndex] = GetChar();
+   while(TryGetChar(&ch) == TRUE) 
+   {
+      // A byte of an upload frame.  The rate of a baud rate request is
+      // binary and can look like UPLOAD_START.
+      if(uploadReceiving() == TRUE || 
+         (ch == UPLOAD_START && baudReceiving() == FALSE)) 
+      {
+         switch(uploadByte(ch, tickCount)) 
+         {
+            case UPLOAD_FRAME:
+               installRecipe();
+               break;
+               
+            case UPLOAD_BAD:
+               TERMIO_PutChar(UPLOAD_NAK);
+               break;
+               
+            default:
+               break;
+         }
+         continue;
+      }
       
+      // The same for a command line.
+      if(lineReceiving() == TRUE || 
+         (ch == LINE_START && baudReceiving() == FALSE)) 
+      {
+         switch(lineChar(ch, tickCount)) 
+         {
+            case LINE_DONE:
+               runCommandLine();
+               break;
+               
+            case LINE_BAD:
+               TERMIO_PutChar(UPLOAD_NAK);
+               break;
+               
+            default:
+               break;
+         }
+         continue;
+      }
       
-   (void)printf("\r\nServoA Command: %c", buffer[0]);
-   (void)printf("\r\nServoB Command: %c\r\n", buffer[1]);
-   
-   servo1UserInput = buffer[0];
-   servo2UserInput = buffer[1];
+      // And for a baud rate request, which answers for itself.
+      if(baudReceiving() == TRUE || ch == BAUD_START) 
+      {
+         baudByte(ch, tickCount);
+         continue;
+      }
+      
+      // Anything else is a key for the servo whose turn it is.
+      buffer[bufferIndex] = ch;
+      if(bufferIndex == 0) 
+      {
+         processServoInput(&servos[0], buffer[0], &servos[1]);
+         bufferIndex = 1;
+         PutString("\n\rCommand for second Servo: ");
+         continue;
+      }
+      processServoInput(&servos[1], buffer[1], &servos[0]);
+      bufferIndex = 0;
+      
+      PutString("\r\nServoA Command: ");
+      TERMIO_PutChar((INT8)buffer[0]);
+      PutString("\r\nServoB Command: ");
+      TERMIO_PutChar((INT8)buffer[1]);
+      PutString("\r\n");
+      PutString("\n\rCommand for first Servo: ");
+   }
 }
 
 //*****************************************************************************
-// This unmitigated piece of crap holds the recipies to be run by each servo. 
+// Gives the servo of an upload frame its recipe and answers the host with
+// UPLOAD_ACK, or UPLOAD_NAK if there is no such servo or the recipe is
+// refused.
 //
 // Parameters: NONE
 //
 // Return: None
 //*****************************************************************************
-void initializeCommands(void)
+void installRecipe(void) 
 {
-
-    enum COMMANDS myCommand, myCommand2, myCommand3, myCommand4, myCommand5;
-
-    myCommand = MOV;
-    myCommand2 = WAIT;
-    myCommand3 = LOOP_START;
-    myCommand4 = END_LOOP; 
-    myCommand5 = BREAK_LOOP;
-    
-    // Fill in the commands for servo A
-    *(servoA.currentCommand) = myCommand+5;  
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+0;  
-    servoA.currentCommand++;
-    //Simple move command check
-    *(servoA.currentCommand) = myCommand+2;  // Test-3
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand;    // Test-3
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+3;  // Test-3
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+3;
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand;
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+4;
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand;
-    servoA.currentCommand++;
-    //This test case is loop check.
-    *(servoA.currentCommand) = myCommand+3;      //Test-2
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand3+0;     //Test-2
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+1;      //Test-2
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+4;      //Test-2
-    servoA.currentCommand++;
-     *(servoA.currentCommand) = myCommand4;      //Test-2
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand;        //Test-2
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand2 + 20;
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+1;
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand;
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+5;
-    servoA.currentCommand++;
-    // this test case is for Break command check.
-    *(servoA.currentCommand) = myCommand+3;      //Test-6
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand3+2;     //Test-6
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+1;      //Test-6
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand5;      //Test-6
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+4;      //Test-6
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+0;      //Test-6
-    servoA.currentCommand++;
-     *(servoA.currentCommand) = myCommand4;      //Test-6
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+5;        //Test-6
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+2;
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = myCommand+3;
-    servoA.currentCommand++;
-    *(servoA.currentCommand) = RECIPE_END;
-  
-    
-    // set the pointer back to the beginning of the buffer.
-    servoA.currentCommand = &bufferServoA;  
-
-    // Fill in the commands for servo B
-    *(servoB.currentCommand) = myCommand+5;  
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+0;  
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+4;  
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+0;  
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+5;  
-    servoB.currentCommand++;
-    // this is MOV command test.
-    *(servoB.currentCommand) = myCommand;     //Test1
-    servoB.currentCommand++;                  
-    *(servoB.currentCommand) = myCommand+5;   //Test1
-    servoB.currentCommand++;                  
-    *(servoB.currentCommand) = myCommand;     //Test1
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+5;
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand;
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+5;
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand;
-    servoB.currentCommand++;
-    //WAIT command test.
-    *(servoB.currentCommand) = myCommand+2;        //Test4
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+3;        //Test4
-    servoB.currentCommand++;
-     *(servoB.currentCommand) = myCommand2 + 31;   //Test4
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand2 + 31;    //Test4
-    servoB.currentCommand++;                       
-    *(servoB.currentCommand) = myCommand2 + 31;    //Test4
-    servoB.currentCommand++;                    
-    *(servoB.currentCommand) = myCommand+4;        //Test4
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+5;
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand;
-    servoB.currentCommand++;
-    //Test for LOOP error.
-    *(servoB.currentCommand) = myCommand+3;      //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand3+2;     //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+1;      //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+4;      //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand3+1;     //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+1;      //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+5;      //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand4;      //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+0;      //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand4;      //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand;        //Test-5
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand+5;
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = myCommand;
-    servoB.currentCommand++;
-    *(servoB.currentCommand) = RECIPE_END;
-
-    // set the pointer back to the beginning of the buffer.
-    servoB.currentCommand = &bufferServoB; 
+   if(uploadServo < servoCount && 
+      changeRecipe(uploadServo, uploadRecipe, uploadLength) == TRUE) 
+   {
+      TERMIO_PutChar(UPLOAD_ACK);
+   } 
+   else 
+   {
+      TERMIO_PutChar(UPLOAD_NAK);
+   }
 }
 
+//*****************************************************************************
+// Carries out every command of a command line, in order, and answers the
+// host with UPLOAD_ACK.  The clocks of the servos the line starts or
+// stops are only synced once all of its commands are carried out, so
+// servos started on the same line start together.  A line that names a
+// servo that does not exist is refused with UPLOAD_NAK and none of its
+// commands are carried out.
+//
+// Parameters: NONE
+//
+// Return: None
+//*****************************************************************************
+void runCommandLine(void) 
+{
+   struct TaskControlBlock* servo;
+   UINT8 timed = 0;        // One bit per servo the line started or stopped.
+   UINT8 index;
+   
+   for(index = 0; index < lineCount; index++) 
+   {
+      if(lineServos[index] >= servoCount) 
+      {
+         TERMIO_PutChar(UPLOAD_NAK);
+         return;
+      }
+   }
+   
+   lineRunning = TRUE;
+   for(index = 0; index < lineCount; index++) 
+   {
+      if(applyServoInput(&servos[lineServos[index]], lineKeys[index],
+                         &servos[(lineServos[index] == 0) ? 1 : 0]) == TRUE) 
+      {
+         timed |= (UINT8)(1 << lineServos[index]);
+      }
+   }
+   lineRunning = FALSE;
+   
+   for(servo = servos; timed != 0; servo++, timed >>= 1) 
+   {
+      if((timed & 0x01) == 0) 
+      {
+         continue;
+      }
+      
+      syncDeadline(servo);
+      finishDeadline(servo);
+   }
+   
+   TERMIO_PutChar(UPLOAD_ACK);
+}
 
-// Initializes SCI0 for 8N1, 9600 baud, polled I/O
-// The value for the baud selection registers is determined
-// using the formula:
+//*****************************************************************************
+// Gives a servo a new recipe.  It goes into the buffer and program the
+// servo is not running from, so the recipe it is running is never
+// touched, once it has been checked and before anything else changes.
+// Until then it is kept in a scratch buffer, so a recipe already staged
+// in the spare buffer stays staged if the new one is refused.  A servo
+// that is paused or has stopped starts the new recipe from the top,
+// paused until the operator continues it.  One that is running has it
+// staged and switches to it at its next instruction without stopping.
+// A refused recipe leaves the servo as it was, whichever it is.
+//
+// Parameters: index   the servo, 0 to servoCount - 1
+//             recipe  the command bytes, copied
+//             length  how many, up to RECIPE_SIZE; the rest of the
+//                     buffer is filled with RECIPE_END
 //
-// SCI0 Baud Rate = ( 2 MHz Bus Clock ) / ( 16 * SCI0BD[12:0] )
+// Return: TRUE if the recipe was loaded or staged, FALSE if it was refused.
+//*****************************************************************************
+UINT8 changeRecipe(UINT8 index, const UINT8* recipe, UINT8 length) 
+{
+   struct TaskControlBlock* servo = &servos[index];
+   const struct ServoChannel* channel = servo->channel;
+   UINT8 spare = (servo->program == programServo[index][0]) ? 1 : 0;   // not running from
+   static UINT8 scratch[RECIPE_SIZE];
+   UINT8 command;
+   
+   for(command = 0; command < RECIPE_SIZE; command++) 
+   {
+      scratch[command] = (command < length) ? recipe[command] : RECIPE_END;
+   }
+   
+   if(stageRecipe(servo, scratch, programServo[index][spare]) == FALSE) 
+   {
+      return FALSE;
+   }
+   
+   for(command = 0; command < RECIPE_SIZE; command++) 
+   {
+      bufferServo[index][spare][command] = scratch[command];
+   }
+   
+   if(servo->status != paused && servo->status != error && servo->recipeEnd != 1) 
+   {
+      return TRUE;
+   }
+   
+   // Forget the old recipe, nothing of it is left running, and start
+   // the new one from the top.
+   wheelRemove(&servo->tickTimer);
+   servo->deadlineState = DEADLINE_IDLE;
+   servo->deadlineLeft = 0;
+   servo->recipeEnd = 0;
+   servo->loopDepth = 0;
+   servo->callDepth = 0;
+   halLedPut(halLedGet() & (UINT8)~(channel->ledPaused | channel->ledRecipeEnd |
+                                    channel->ledLoopError | channel->ledCommandError));
+   
+   servo->program = servo->staged;
+   servo->currentCommand = servo->staged;
+   servo->staged = 0;
+   servo->status = paused;
+   halLedPut(halLedGet() | channel->ledPaused);
+   
+   return TRUE;
+}
+
+// The command bytes of the recipe a servo is running.
 //--------------------------------------------------------------
-void InitializeSerialPort(void)
+const UINT8* runningRecipe(UINT8 index) 
+{
+   return bufferServo[index][(servos[index].program == programServo[index][0]) ? 0 : 1];
+}
+
+//*****************************************************************************
+// This unmitigated piece of crap holds the recipies to be run by each servo. 
+// These are only what the servos run after a reset, a recipe uploaded
+// over SCI0 (see upload.h) replaces them.
+//
+// Parameters: NONE
+//
+// Return: None
+//*****************************************************************************
+void initializeCommands(void)
 {
-    // Set baud rate to ~9600 (See above formula)
-    SCI0BD = 13;          
-    
-    // 8N1 is default, so we don't have to touch SCI0CR1.
-    // Enable the transmitter and receiver.
-    SCI0CR2_TE = 1;
-    SCI0CR2_RE = 1;
+    static const UINT8 recipeA[] =
+    {
+      MOV+5, MOV+0,
+      //Simple move command check
+      MOV+2, MOV+0, MOV+3,                               // Test-3
+      MOV+3, MOV+0, MOV+4, MOV+0,
+      //This test case is loop check.
+      MOV+3, LOOP_START+0, MOV+1, MOV+4, END_LOOP,       // Test-2
+      MOV+0,                                             // Test-2
+      WAIT+20, MOV+1, MOV+0, MOV+5,
+      // this test case is for Break command check.
+      MOV+3, LOOP_START+2, MOV+1, BREAK_LOOP, MOV+4,     // Test-6
+      MOV+0, END_LOOP, MOV+5,                            // Test-6
+      MOV+2, MOV+3,
+      RECIPE_END
+    };
+    static const UINT8 recipeB[] =
+    {
+      MOV+5, MOV+0, MOV+4, MOV+0, MOV+5,
+      // this is MOV command test.
+      MOV+0, MOV+5, MOV+0,                               // Test1
+      MOV+5, MOV+0, MOV+5, MOV+0,
+      //WAIT command test.
+      MOV+2, MOV+3, WAIT+31, WAIT+31, WAIT+31, MOV+4,    // Test4
+      MOV+5, MOV+0,
+      //Nested loop test.
+      MOV+3, LOOP_START+2, MOV+1, MOV+4,                 // Test-5
+      LOOP_START+1, MOV+1, MOV+5, END_LOOP,              // Test-5
+      MOV+0, END_LOOP, MOV+0,                            // Test-5
+      MOV+5, MOV+0,
+      RECIPE_END
+    };
+    // Subroutine 0 of the common recipe sweeps from one end to the
+    // other and back.
+    static const UINT8 recipeCommon[] =
+    {
+      MOV+0, MOV+5, MOV+0, RET,
+      RECIPE_END
+    };
+    UINT8 index;
+
+    for(index = 0; index < sizeof(recipeA); index++)
+    {
+       bufferServo[0][0][index] = recipeA[index];
+    }
+    for(index = 0; index < sizeof(recipeB); index++)
+    {
+       bufferServo[1][0][index] = recipeB[index];
+    }
+    for(index = 0; index < sizeof(recipeCommon); index++)
+    {
+       bufferCommon[index] = recipeCommon[index];
+    }
+
+    // Decode the recipes and point the servos at the first command.
+    // The common recipe goes first, the others call into it.
+    (void)loadCommon(bufferCommon, programCommon);
+    for(index = 0; index < servoCount; index++)
+    {
+       (void)loadRecipe(&servos[index], bufferServo[index][0], programServo[index][0]);
+    }
 }
 
 //*****************************************************************************
@@ -360,468 +461,183 @@ void InitializeSerialPort(void)
 //*****************************************************************************
 void initializeServos(void) 
 {
-  const UINT8 TwentymsTicks = 250; // There are 250 ticks in 20ms.
-  
-  PWME   = 0x00; // Disable All servos
-  PWMCAE = 0x00; // Set the outputs for all PWMs to left aligned
-  PWMPOL = 0x03; // Set the pulse Width Channel 0 and 1 Polarity to high.
+  UINT8 index;
   
-  // Bus Clock is 2MHz.
-  PWMPRCLK=0x04; // Set clock A to bus clock / 16  = 125000 Hz
-  PWMSCLA= 0x05; // Clock SA = Clock A / (2 * PWMSCLA)    = 12500 Hz
-  PWMCLK = 0x03; // select Scaled Clock A (SA) for PWM channel 0 and 
-                 // PWM channel 1                
-  PWMCTL = 0x00; // set everthing in the PWMCTL registers to 0 to
-                 // provide a baseline.
+  // Disable all servos and set up the PWM clocks for all channels.
+  halPwmInit();
                  
   // Initialize the Task Control Blocks.
-  servoA.status  = paused;
-  servoA.currentCommand = &bufferServoA; 
-  servoA.loopFlag = FALSE;
-  servoA.loopCounter = 0;
-  servoA.firstLoopInstruction = 0;
-  servoA.currentServoPosition = 255;  // These are 255 so that if the first command is to 
-                                      // go to position 0 it will go there. 
-  servoA.expectedServoPosition = 255; // These are 255 so that if the first command is to 
-                                      // go to position 0 it will go there. 
-  servoA.timeLeftms = 0;
-  
-  servoB.status = paused;
-  servoB.currentCommand = &bufferServoB;
-  servoB.loopFlag = FALSE;
-  servoB.loopCounter = 0;
-  servoB.firstLoopInstruction = 0;
-  servoB.currentServoPosition = 255;  // These are 255 so that if the first command is to 
-                                      // go to position 0 it will go there.  
-  servoB.expectedServoPosition = 255; // These are 255 so that if the first command is to 
-                                      // go to position 0 it will go there. 
-  servoB.timeLeftms = 0;
+  for(index = 0; index < SERVO_COUNT; index++)
+  {
+    servos[index].status = paused;
+    servos[index].program = programServo[index][0];
+    servos[index].staged = 0;
+    servos[index].currentCommand = programServo[index][0];
+    servos[index].channel = &servoChannels[index];
+    servos[index].recipeEnd = 0;
+    servos[index].loopDepth = 0;
+    servos[index].callDepth = 0;
+    servos[index].currentServoPosition = 255;  // These are 255 so that if the first command is to 
+                                               // go to position 0 it will go there. 
+    servos[index].expectedServoPosition = 255; // These are 255 so that if the first command is to 
+                                               // go to position 0 it will go there. 
+    servos[index].deadlineState = DEADLINE_IDLE;
+    servos[index].deadlineLeft = 0;
+    servos[index].tickTimer.slot = 0;
+    servos[index].tickTimer.owner = &servos[index];
+  }
+  wheelInit(&tickWheel);
   
   //Initialize the status LED port.
-  DDRA = 0xFF;
+  halLedInit();
 }
 
 // Initializes I/O and timer settings for the demo.
 //--------------------------------------------------------------       
 void InitializeTimer(void)
 {
-  // Set the timer prescaler to %2, since the bus clock is at 2 MHz,
-  // and we want the timer running at 1 MHz
-  TSCR2_PR0 = 1;
-  TSCR2_PR1 = 0;
-  TSCR2_PR2 = 0;
-    
-  // Enable output compare on Channel 1
-  TIOS_IOS1 = 1;
-  
-  // Set up output compare action to toggle Port T, bit 1
-  TCTL2_OM1 = 0;
-  TCTL2_OL1 = 1;
-  
-  // Set up timer compare value
-  TC1 = TC1_VAL;
-  
-  // Clear the Output Compare Interrupt Flag (Channel 1) 
-  TFLG1 = TFLG1_C1F_MASK;
-  
-  // Enable the output compare interrupt on Channel 1;
-  TIE_C1I = 1;  
-  
-  //
-  // Enable the timer
-  // 
-  TSCR1_TEN = 1;
+  // Run the timer at TIMER_CLK_FREQ and enable the Output Compare
+  // Channel 1 interrupt.
+  halTimerInit(TC1_VAL);
    
   //
-  // Enable interrupts via macro provided by hidef.h
+  // Enable interrupts (EnableInterrupts from hidef.h on the board)
   //
-  EnableInterrupts;
+  halEnableInterrupts();
 }
 
 //*****************************************************************************
-// This unmitigated piece of crap will process the commands that make up a
-// recipie.
+// Processes the command the user typed for one servo.
 //
-// Parameters:  servo          Holds a pointer to the servos Task Control Block.
-//              command        The Command to be executed by the servo.
-//              commandContext The context of the comamnd extracted fromt the one
-//                             byte command.
+// Parameters:  servo          The servo the command is for.
+//              input          The key typed for the servo, 0 if none.
+//              other          The servo whose recipe the swap command takes.
 //
-// Return: None
+// Return: None.
 //*****************************************************************************
-void processCommand (struct TaskControlBlock* servo, enum COMMANDS command, UINT8 commandContext)
-{ 
-  UINT16 positionChange = 0;
-  const UINT16 PerPositionIncrementms = 200;
-  const UINT16 waitTimeIncrementms = 100;
-  
-  switch(command) 
-  {
-     case RECIPE_END:
-          //printf("\r\n processCommand: RECIPE_END\r\n");
-          // Turn off the servos
-           if(servo == &servoA) 
-              {
-                 // if both servos are on only turn off servo A
-                 if (PWME == 0x03) 
-                 {
-                    PWME = 0x02;
-                 } 
-                 else {
-                    PWME = 0x00;
-                 }
-                 
-                 // Set the status LED for this commands.
-                 PORTA = PORTA | 0x20;
-                 
-                 // Flag is set for reciepe end so that the servo will not process any more commands.
-                 reciepeEndServoA = 1;    
-              } 
-              else if(servo == &servoB)
-              {
-                 // if both servos are on only turn off servo B
-                 if (PWME == 0x03) 
-                 {
-                    PWME = 0x01;
-                 } 
-                 else {
-                    PWME = 0x00;
-                 }
-                 
-                 // Set the status LED for this commands.
-                 PORTA = PORTA | 0x02;
-                 
-                 // Flag is set for reciepe end so that the servo will not process any more commands.
-                 reciepeEndServoB = 1; 
-              } 
-          break;
-     case MOV:
-         //printf("\r\n processCommand: MOV %d\r\n", commandContext);
-        // Check to make sure the command is valid.
-        // The positions are 0-5
-        if(commandContext < 6) 
-        {
-           // if the servo position in the command is different to the
-           // the current position proces it.
-              // update the expected servo position
-              servo->expectedServoPosition = commandContext;
-        
-              // Calculate out the amount of time it will take the command
-              // to run.
-              if(servo->currentServoPosition == 255) 
-              {
-                 positionChange =  commandContext;
-              }
-              else if(servo->expectedServoPosition < servo->currentServoPosition) 
-              {
-                 positionChange = servo->currentServoPosition - servo->expectedServoPosition; 
-              } 
-              else
-              {
-                 positionChange = servo->expectedServoPosition - servo->currentServoPosition;
-              } 
-          
-              //printf("\r\nprocessCommand: setting positionChange %u\r\n", positionChange);
-          
-              servo->timeLeftms = positionChange * PerPositionIncrementms;
-             // printf("\r\nprocessCommand: setting processCommand %u\r\n", servo->timeLeftms);
-          
-              // Send the commands down the PWM channel.
-              // figure out which channel to send it down on.
-              if(servo == &servoA) 
-              {
-          
-                 //printf("\r\nprocessCommand: setting servoA\r\n");
-                 PWMDTY0 = servoPositionTicks[servo->expectedServoPosition];
-                 PWME = PWME |0x01; 
-              } 
-              else if(servo == &servoB)
-              {
-                 //printf("\r\nprocessCommand: setting servoB\r\n");
-                 PWMDTY1 = servoPositionTicks[servo->expectedServoPosition];
-                 PWME = PWME |0x02;
-              } 
-              else {
-                 printf("\r\nprocessCommand: undefined servo\r\n");
-              }
-          
-              // Update the Task Control Block Status.
-              servo->status = running;
-              servo->currentCommand++;
-
-        }
-    
-        break;
-     case WAIT:
-        // The wait lengths are 0-31
-        
-        //printf("\r\n processCommand: WAIT %d\r\n", commandContext);
-        if(commandContext < 32) 
-        {   
-            // Calculate out the amount of time it will take the command
-            // to run.
-            servo->timeLeftms = (commandContext) * waitTimeIncrementms;
-            
-            // Update the Task Control Block Status.
-            if(servo == &servoA || servo == &servoB) 
-            {    
-              // increment the command buffer;
-              servo->currentCommand++;
-            } 
-            else 
-            {
-              printf("\r\nprocessCommand: undefined servo\r\n");
-            }
-                               
-            servo->status = running;    
-        }
-        
-        break;
-        
-     case LOOP_START:
-        //printf("\r\n processCommand: LOOPSTART %d\r\n", commandContext);
-                  
-        // if we do not have a nested loop set things up for
-        // a loop.
-        if(servo->loopFlag == FALSE) 
-        {
-           servo->loopFlag = TRUE;
-            
-           // Set the number of iterations.
-           servo->loopCounter = commandContext;
-            
-           // Set a pointer to the instruction after the
-           // LOOPSTART command and move onto the next
-           // instruction.
-           servo->firstLoopInstruction = servo->currentCommand + 1;
-           
-           // Increment the instruction pointer.
-           servo->currentCommand++;
-           
-           // Rajeev we need LED status lights here.  
-         } 
-         else 
-         {
-            // place the task in an error state.
-            servo->status = error;
-            
-            // indicate an error for that servo.
-            if(servo == &servoA)
-            {
-              printf("\r\nprocessCommand: Nested Loop Error for servoA\r\n");
-              PORTA = PORTA | 0x40;        // Reciepy command error.
-            } else if(servo == &servoB){
-              printf("\r\nprocessCommand: Nested Loop Error for servoB\r\n");
-              PORTA = PORTA | 0x04;        // Reciepy command error.
-      
-            } 
-         }
-         
-         break;
-         
-     case END_LOOP:
-        //printf("\r\n processCommand: END_LOOP\r\n");
-        
-        // if we are not on our last iteration of the loop
-        if(servo->loopCounter > 0) 
-        {  
-           // Go back to the instruction after the LOOP_START command.
-           servo->currentCommand = servo->firstLoopInstruction;
-           
-           // deincrement the loop counter.
-           --(servo->loopCounter);
-        } 
-        else 
-        {
-           // Ok we're done with the loop.  Clean up the TCB and
-           // go to the next instruction.
-           servo->loopFlag = FALSE;
-           servo->firstLoopInstruction = 0;
-           
-           
-           if(servo == &servoA || servo == &servoB) 
-           {    
-             // increment the command buffer;
-             servo->currentCommand++;
-           } 
-           else 
-           {
-             printf("\r\nprocessCommand: undefined servo\r\n");
-           }
-        }
-          
-        break;
-        
-     case BREAK_LOOP :
-        //printf("\r\n processCommand: BREAK_LOOP\r\n");
-        
-        //While loop will shift the pointer to the end of current loop. 
-        while(*servo->currentCommand != END_LOOP) {
-          servo->currentCommand++;
-        }
-        
-        // clean up the TCB since were out of the loop.
-        servo->loopFlag = FALSE;
-        servo->firstLoopInstruction = 0;
-           
-        servo->currentCommand++; //finally we are pointing to next command in reciepe.
-        
-        break;
-          
-     default:
-     
-        // set the status lights to indicate a recipe command error.
-        if(servo == &servoA)
-        {
-           printf("\r\nprocessCommand: undefined command for servoA\r\n");
-           PORTA = PORTA | 0x80;        // Recipe command error.
-        } else if(servo == &servoB){
-           printf("\r\nprocessCommand: undefined command for servoB\r\n");
-           PORTA = PORTA | 0x08;        // Recipe command error.
-        } 
-        else 
-        {
-           printf("\r\nprocessCommand: Unknown error occured.\r\n");
-        }
-  } 
+void processServoInput(struct TaskControlBlock* servo, UINT8 input, struct TaskControlBlock* other) 
+{
+   // Any other key, or one the servo was in no state for, leaves its
+   // timing alone.
+   if(applyServoInput(servo, input, other) == FALSE) 
+   {
+      return;
+   }
+   
+   // Stop or restart the clock on its MOV or WAIT.
+   syncDeadline(servo);
+   
+   // A servo the command left ready runs its next command now rather
+   // than on the next tick.
+   finishDeadline(servo);
 }
 
 //*****************************************************************************
-// This unmitigated piece of crap will process the commands input from the user.
+// Carries out a key for one servo, all but the clock on its MOV or WAIT,
+// which is left for the caller to sync.
 //
-// Parameters: NONE
+// Parameters:  servo          The servo the command is for.
+//              input          The key typed for the servo, 0 if none.
+//              other          The servo whose recipe the swap command takes.
 //
-// Return: None.
+// Return: TRUE if the key started, paused, restarted or moved the servo.
 //*****************************************************************************
-void processUserCommand(void) 
+static UINT8 applyServoInput(struct TaskControlBlock* servo, UINT8 input, struct TaskControlBlock* other) 
 {
-   // process command
+   const struct ServoChannel* channel = servo->channel;
+   UINT8 timed = FALSE;    // TRUE once the key has started or stopped the servo.
    
      // process the continue command.
-   if((servo1UserInput == 0x63 || servo1UserInput == 0x43) &&
-       servoA.status != error && (firstThree(*servoA.currentCommand)) != RECIPE_END) 
+   if((input == 0x63 || input == 0x43) &&
+       servo->status != error && servo->currentCommand->command != RECIPE_END) 
    {
-      servoA.status  = running;
-      PORTA = PORTA & 0xEF;
-      //printf("\r\n processUserCommand: servoA.status = running\r\n");
-   }
-   
-   if((servo2UserInput == 0x63 || servo2UserInput == 0x43) && 
-      servoB.status != error && (firstThree(*servoB.currentCommand)) != RECIPE_END) 
-   {
-      servoB.status  = running;
-      PORTA = PORTA & 0xFE;
-     // printf("\r\n processUserCommand: servoB.status = running\r\n");
+      timed = TRUE;
+      servo->status  = running;
+      halLedPut(halLedGet() & (UINT8)~channel->ledPaused);
    }
    
       // process the pause command.
-   if((servo1UserInput == 0x50 || servo1UserInput == 0x70) &&
-       servoA.status != error  && (firstThree(*servoA.currentCommand)) != RECIPE_END) 
-   {
-      printf("\r\nYou have following options: \n\r l = Move left \n\r r = Move Right\n\r s = Switch Reciepe\n\r c = Continue reciepe\n\r n = no-op\n\r b = Restart reciepe");
-      servoA.status  = paused;
-      PORTA = PORTA | 0x10;
-      //printf("\r\n processUserCommand: servoA.status = paused\r\n");
-   }
-   
-   if((servo2UserInput == 0x50 || servo2UserInput == 0x70) && 
-      servoB.status != error && (firstThree(*servoB.currentCommand)) != RECIPE_END) 
+   if((input == 0x50 || input == 0x70) &&
+       servo->status != error  && servo->currentCommand->command != RECIPE_END) 
    {
-      servoB.status = paused;
-      PORTA = PORTA | 0x01;
-      //printf("\r\n processUserCommand: servoB.status = paused\r\n");
+      if(lineRunning == FALSE) 
+      {
+         PutString("\r\nYou have following options: \n\r l = Move left \n\r r = Move Right\n\r s = Switch Reciepe\n\r c = Continue reciepe\n\r n = no-op\n\r b = Restart reciepe");
+      }
+      timed = TRUE;
+      servo->status  = paused;
+      halLedPut(halLedGet() | channel->ledPaused);
    }
    
        // process the restart command.
-   if((servo1UserInput == 0x42 || servo1UserInput == 0x62)) 
-   {
-      servoA.currentCommand = &bufferServoA;
-      servoA.status  = ready;
-      PORTA = PORTA & 0x0F;
-      reciepeEndServoA = 0;
-      servoA.loopFlag = FALSE;
-      //printf("\r\n processUserCommand: B is pressed for ServoA.\r\n");
-   }
-   
-    if((servo2UserInput == 0x42 || servo2UserInput == 0x62)) 
+   if((input == 0x42 || input == 0x62)) 
    {
-      servoB.currentCommand = &bufferServoB;
-      servoB.status = ready;
-      PORTA = PORTA & 0xF0;
-      reciepeEndServoB = 0;
-      servoB.loopFlag = FALSE;
-      //printf("\r\n processUserCommand: B is pressed for ServoB\r\n");
+      timed = TRUE;
+      servo->currentCommand = servo->program;
+      servo->status  = ready;
+      halLedPut(halLedGet() & (UINT8)~(channel->ledPaused | channel->ledRecipeEnd |
+                                       channel->ledLoopError | channel->ledCommandError));
+      servo->recipeEnd = 0;
+      servo->loopDepth = 0;
+      servo->callDepth = 0;
    }
    
         // process the no-op command.
-   if((servo1UserInput == 0x4E || servo1UserInput == 0x6E) &&
-       servoA.status != error ) 
+   if((input == 0x4E || input == 0x6E) &&
+       servo->status != error ) 
    {
-      servoA.status  = donothing;
-      //printf("\r\n processUserCommand: B is pressed for ServoA.\r\n");
-   }
-   
-    if((servo2UserInput == 0x4E || servo2UserInput == 0x6E) && 
-      servoB.status != error ) 
-   {
-      servoB.status = donothing;
-      //printf("\r\n processUserCommand: B is pressed for ServoB\r\n");
+      timed = TRUE;
+      servo->status  = donothing;
    }
    
    // process the run Right command.
-   if((servo1UserInput == 0x52 || servo1UserInput == 0x72) &&
-       servoA.status != error ) 
-   {
-      if(servoA.currentServoPosition != 0){
-        processCommand(&servoA,MOV, --servoA.currentServoPosition );
-      }
-      servoA.status = donothing;      
-   }
-   
-    if((servo2UserInput == 0x52 || servo2UserInput == 0x72) && 
-      servoB.status != error ) 
+   if((input == 0x52 || input == 0x72) &&
+       servo->status != error ) 
    {
-      if(servoB.currentServoPosition != 0){
-      processCommand(&servoB,MOV, --servoB.currentServoPosition);
+      if(servo->currentServoPosition != 0 && servo->currentServoPosition != 255){
+        keyMove(servo, (UINT8)((servo->currentServoPosition - 1) / FINE_STEPS_PER_POSITION));
       }
-      servoB.status = donothing;
+      timed = TRUE;
+      servo->status = donothing;      
    }
    
     // process the run Left command.
-   if((servo1UserInput == 0x4C || servo1UserInput == 0x6C) &&
-       servoA.status != error ) 
+   if((input == 0x4C || input == 0x6C) &&
+       servo->status != error ) 
    {
-      if(servoA.currentServoPosition != 5){
-          processCommand(&servoA,MOV, ++servoA.currentServoPosition);
+      if(servo->currentServoPosition == 255){
+          keyMove(servo, 0);
       }
-      servoA.status = donothing;
-   }
-   
-    if((servo2UserInput == 0x4C || servo2UserInput == 0x6C) && 
-      servoB.status != error ) 
-   {
-      if(servoB.currentServoPosition != 5){
-          processCommand(&servoB,MOV, ++servoB.currentServoPosition);
+      else if(servo->currentServoPosition < MAX_FINE_POSITION){
+          keyMove(servo, (UINT8)(servo->currentServoPosition / FINE_STEPS_PER_POSITION + 1));
       }
-      servoB.status = donothing;
-   }
-   
-     // Process the swap Command which changes the reciepe for the servos.
-   if((servo1UserInput == 0x53 || servo1UserInput == 0x73) &&
-       servoA.status != error ) 
-   {
-      servoA.currentCommand = servoB.currentCommand;
+      timed = TRUE;
+      servo->status = donothing;
    }
    
-    if((servo2UserInput == 0x53 || servo2UserInput == 0x73) && 
-      servoB.status != error ) 
+     // Process the swap Command which gives the servo a copy of the
+     // other servo's recipe, switched to at its next instruction.
+   if((input == 0x53 || input == 0x73) &&
+       servo->status != error ) 
    {
-      servoB.currentCommand = servoA.currentCommand;
+      (void)changeRecipe((UINT8)(servo - servos), runningRecipe((UINT8)(other - servos)), 
+                         RECIPE_SIZE);
    }
    
-   // set global variables to 0 so we know we have new input
-   servo1UserInput = 0;
-   servo2UserInput = 0;
+   return timed;
+}
+
+// Moves a servo to a position 0-5 for the l and r keys, there straight
+// away.  The servo stays where it is in its recipe, a MOV from the keys
+// is not one of its commands.
+//--------------------------------------------------------------
+static void keyMove(struct TaskControlBlock* servo, UINT8 position)
+{
+   struct Instruction* next = servo->currentCommand;
+
+   servo->currentServoPosition = (UINT8)(position * FINE_STEPS_PER_POSITION);
+   processCommand(servo, MOV, position);
+   servo->currentCommand = next;
 }
 
 //*****************************************************************************
@@ -835,72 +651,86 @@ void processUserCommand(void)
 //*****************************************************************************
 void runTasks(void) 
 { 
-   // first process the user commands
-   processUserCommand();
- 
-   // then run the recipies based on the changes from the processUserCommand
-   // function.
-   if(servoA.status  == ready && reciepeEndServoA != 1) 
-   {
-     // get the next command and process it.
-     processCommand(&servoA,firstThree(*servoA.currentCommand), lastFive(*servoA.currentCommand));
-   } 
-   else if(servoA.status  == running)  
+   struct TaskControlBlock* servo;
+   
+   // Count down the servos without a timer channel.
+   tickTimers();
+   
+   // run the recipies, the user commands have been carried out
+   // by getUserInput as they came in.
+   for(servo = servos; servo < &servos[servoCount]; servo++) 
    {
-     updateTaskStatus(&servoA);
+      if(servo->status  == ready && servo->recipeEnd != 1) 
+      {
+        // get the next command and process it.
+        runNextCommand(servo);
+      } 
+      else if(servo->status  == running)  
+      {
+        updateTaskStatus(servo);
+      }
    }
+}
 
-   if(servoB.status  == ready && reciepeEndServoB != 1) 
-   {
-     processCommand(&servoB, firstThree(*servoB.currentCommand), lastFive(*servoB.currentCommand));
-   } 
-   else if (servoB.status  == running)
+//*****************************************************************************
+// Runs the tasks once for every tick OC1_isr has counted since the last
+// call.  Called from the main loop, never from interrupt context, so the
+// tasks are free to printf.
+//
+// Parameters: NONE
+//
+// Return: None.
+//*****************************************************************************
+void dispatchTasks(void) 
+{
+   if(tasksPending == TRUE) 
    {
-     updateTaskStatus(&servoB);
+      tasksPending = FALSE;
+      
+      runDeadlines();
+      
+      while(ticksRun != tickCount) 
+      {
+         ticksRun++;
+         traceEvent(TRACE_TICK, 0, ticksRun);
+         runTasks();
+      }
    }
 }
 
 //*****************************************************************************
-// This unmitigated piece of crap updates the amount of time left for a command
-// running on a servo.  If the amount of time has expired then it sets the task
-// status to ready.
+// Finishes the MOV or WAIT of every servo whose deadline has passed and
+// runs its next command straight away rather than on the next tick.
 //
 // Parameters: NONE
 //
 // Return: None.
 //*****************************************************************************
-void updateTaskStatus(struct TaskControlBlock* servo) 
+void runDeadlines(void) 
 {
-   // Right now all we need to do is deincrement the timers
-   // and update the task status to ready once the timer
-   // for a thread has run out.
+   struct TaskControlBlock* servo;
+   UINT8 expired;
    
-   // We are processing a command
-   if(servo->status  == running) {
-      
-      //printf("\r\nprocessCommand: updateTaskStatus servo->timeLeftms %u\r\n", servo->timeLeftms);
-      
-      if(servo->timeLeftms > 0) 
-      {
-        //printf("\r\n updateTaskStatus: updateTime == TRUE && servo->timeLeftms > 0\r\n");
-      
-        servo->timeLeftms -=100;
-      } 
-      else 
+   halDisableInterrupts();
+   expired = deadlinesExpired;
+   deadlinesExpired = 0;
+   halEnableInterrupts();
+   
+   for(servo = servos; expired != 0; servo++, expired >>= 1) 
+   {
+      if((expired & 0x01) == 0) 
       {
-        // update time is 0.  set the servo postion to the expected
-        // position and update the task status to ready.
-        servo->currentServoPosition = servo->expectedServoPosition;
-        servo->status = ready;
-          
-        //printf("\r\n updateTaskStatus: servostatus = ready\r\n");
+         continue;
       }
+      
+      finishDeadline(servo);
    }
 }
   
 
 // Output Compare Channel 1 Interrupt Service Routine
-// Refreshes TC1 and clears the interrupt flag.
+// Refreshes TC1, clears the interrupt flag and counts the tick.
+// The tasks themselves are run by dispatchTasks in the main loop.
 //          
 // The first CODE_SEG pragma is needed to ensure that the ISR
 // is placed in non-banked memory. The following CODE_SEG
@@ -918,60 +748,52 @@ void updateTaskStatus(struct TaskControlBlock* servo)
 #pragma push
 #pragma CODE_SEG __SHORT_SEG NON_BANKED
 //--------------------------------------------------------------       
-void interrupt 9 OC1_isr( void )
+HAL_ISR(9, OC1_isr)
 {
-  TC1     +=  TC1_VAL;      
-  TFLG1   =   TFLG1_C1F_MASK;  
+  halTimerAcknowledge(TC1_VAL);
   
-  runTasks();
+  tickCount++;
+  tasksPending = TRUE;
 }
-#pragma pop
 
-
-// This function is called by printf in order to
-// output data. Our implementation will use polled
-// serial I/O on SCI0 to output the character.
-//
-// Remember to call InitializeSerialPort() before using printf!
-//
-// Parameters: character to output
+// Output compare channels 2 to 7 time the commands of servos A to F,
+// with PWM_16BIT 2 to 5 those of servos A to D and 6 and 7 are never
+// armed.  Each needs its VECTOR ADDRESS line in Project.prm as well,
+// 0xFFEA for TC2_isr down to 0xFFE0 for TC7_isr.
 //--------------------------------------------------------------       
-void TERMIO_PutChar(INT8 ch)
+static void servoDeadline(UINT8 index)
 {
-    // Poll for the last transmit to be complete
-    do
-    {
-      // Nothing  
-    } while (SCI0SR1_TC == 0);
-    
-    // write the data to the output shift register
-    SCI0DRL = ch;
-}
-
-// Polls for a character on the serial port.
-//
-// Returns: Received character
-//--------------------------------------------------------------       
-UINT8 GetChar(void)
-{ 
-  // Poll for data
-  
-  do
+  if(deadlineInterrupt(&servos[index]) == TRUE) 
   {
-    // Nothing
-  } while(SCI0SR1_RDRF == 0);
-   
-  // Fetch and return data from SCI0
-  return SCI0DRL;
+    deadlinesExpired |= (UINT8)(1 << index);
+    tasksPending = TRUE;
+  }
 }
 
+HAL_ISR(10, TC2_isr) { servoDeadline(0); }
+HAL_ISR(11, TC3_isr) { servoDeadline(1); }
+HAL_ISR(12, TC4_isr) { servoDeadline(2); }
+HAL_ISR(13, TC5_isr) { servoDeadline(3); }
+#ifndef PWM_16BIT
+HAL_ISR(14, TC6_isr) { servoDeadline(4); }
+HAL_ISR(15, TC7_isr) { servoDeadline(5); }
+#else
+HAL_ISR(14, TC6_isr) { }
+HAL_ISR(15, TC7_isr) { }
+#endif
+#pragma pop
+
 
 // Entry point of our application code
 // Initializes the 
 //--------------------------------------------------------------       
 void main(void)
 {
-  UINT8 userInputbuffer[100];
+  UINT8 ch;
+  
+  // Everything after this runs at BUS_CLK_FREQ.
+  halClockInit();
+  
   InitializeSerialPort();
   
   // This function has to be before the InitializeTimer function.
@@ -981,11 +803,38 @@ void main(void)
   initializeCommands(); 
    
   // Show initial prompt
-  (void)printf("Hey Babe I'm just too cool!\r\n");
+  PutString("Hey Babe I'm just too cool!\r\n");
   
    while(1)
    {
+      dispatchTasks();
+      
+      // Give up on an upload frame or a command line that has stopped
+      // coming in before any more bytes are taken as part of it.
+      uploadPoll(tickCount);
+      linePoll(tickCount);
       getUserInput();
-
+      baudPoll(tickCount);
+      
+      // Send what the tasks traced while the line is free, and not while
+      // the baud rate is being changed.
+      if(baudHolding() == FALSE) 
+      {
+         traceFlush();
+      }
+      
+      // Sleep until the next interrupt unless one came in while we
+      // were busy and left more work.  A byte received after
+      // getUserInput emptied the queue is more work too, SCI0_isr does
+      // not flag it.
+      halDisableInterrupts();
+      if(tasksPending == TRUE || PeekChar(&ch) == TRUE) 
+      {
+         halEnableInterrupts();
+      } 
+      else 
+      {
+         halWaitForInterrupt();
+      }
    }
 }
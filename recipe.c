@@ -0,0 +1,866 @@
+/******************************************************************************
+ * recipe.c
+ *
+ * Description:
+ *
+ * Recipe interpreter.  processCommand looks the command up in a table of
+ * handlers indexed by its three bit opcode and everything a handler needs
+ * to know about the hardware comes from the servo's ServoChannel, so no
+ * command has to work out which servo it is running on.
+ *
+ *****************************************************************************/
+
+// project includes
+#include "types.h"
+#include "clock.h"      /* bus clock */
+#include "hal.h"        /* hardware abstraction layer */
+#include "sci.h"        /* SCI0 terminal driver */
+#include "recipe.h"
+#include "timerwheel.h"
+#include "trace.h"
+
+// These are the basic PWMDTY values, in PWM_CLK_FREQ ticks
+// They vary depending on where the positions
+// are marked on the boxes.  1 tick = ~ 10 degrees.
+// TODO.  Needs some tuning.
+//POS0_TICKS   0x05
+//POS1_TICKS   0X09
+//POS2_TICKS   0X0C
+//POS3_TICKS   0X0F
+//POS4_TICKS   0X14
+//POS5_TICKS   0X18
+// The fine positions in between are interpolated from them, see
+// positionDuty, so they have to go up from position 0 to 5.
+const UINT8 servoPositionTicks[6] = {0x05, 0X09, 0X0C, 0X0F, 0X14, 0X18};
+
+// Time a MOV takes per position travelled and a WAIT per unit.
+#define PER_POSITION_INCREMENT_MS  200
+#define WAIT_TIME_INCREMENT_MS     100
+
+// A fine MOV takes the same time per step, a whole number of ms.
+#define FINE_STEP_MS  (PER_POSITION_INCREMENT_MS / FINE_STEPS_PER_POSITION)
+STATIC_ASSERT(fineStepWholeMs, PER_POSITION_INCREMENT_MS % FINE_STEPS_PER_POSITION == 0);
+
+// The servo number in trace records, 0 for servo A.
+#define traceServo(servo)  ((UINT8)((servo)->channel->name - 'A'))
+
+// OC1_isr ticks every TC1_VAL counts of the timer, TIMER_COUNTS_PER_MS
+// (clock.h) to the millisecond.
+#define TICK_MS                    50
+
+static void startTimer(struct TaskControlBlock* servo, UINT16 ms);
+static void armDeadline(struct TaskControlBlock* servo, UINT32 counts);
+static void armTickTimer(struct TaskControlBlock* servo, UINT16 ticks);
+static UINT16 positionDuty(UINT8 position);
+
+struct TimerWheel tickWheel;
+
+// A subroutine of the common recipe.
+struct Subroutine
+{
+   struct Instruction* entry;   // its first instruction, 0 if not defined
+   UINT8 loopDepth;             // deepest loop nesting in it and what it calls
+   UINT8 callDepth;             // 1, or 1 more than the deepest it calls
+};
+
+static struct Subroutine subroutines[MAX_SUBROUTINES];
+
+static void processRecipeEnd(struct TaskControlBlock* servo, UINT8 commandContext);
+static void processMov(struct TaskControlBlock* servo, UINT8 commandContext);
+static void processWait(struct TaskControlBlock* servo, UINT8 commandContext);
+static void processBreakLoop(struct TaskControlBlock* servo, UINT8 commandContext);
+static void processLoopStart(struct TaskControlBlock* servo, UINT8 commandContext);
+static void processEndLoop(struct TaskControlBlock* servo, UINT8 commandContext);
+static void processCall(struct TaskControlBlock* servo, UINT8 commandContext);
+static void processRet(struct TaskControlBlock* servo, UINT8 commandContext);
+static void callError(struct TaskControlBlock* servo);
+static UINT8 decodeRecipe(const UINT8* recipe, struct Instruction* program, UINT8 first,
+                          struct Subroutine* subroutine);
+
+// Command handlers indexed by the top three bits of the command byte.
+static void (*const commandHandlers[8])(struct TaskControlBlock* servo, UINT8 commandContext) =
+{
+   processRecipeEnd,    // 000 RECIPE_END
+   processMov,          // 001 MOV
+   processWait,         // 010 WAIT
+   processBreakLoop,    // 011 BREAK_LOOP
+   processLoopStart,    // 100 LOOP_START
+   processEndLoop,      // 101 END_LOOP
+   processCall,         // 110 CALL
+   processRet           // 111 RET
+};
+
+
+//*****************************************************************************
+// Decodes the common recipe, a run of subroutines each ending with a RET
+// and the lot ending with a RECIPE_END.  A subroutine can CALL the ones
+// before it but not itself or the ones after, so calls can never go
+// round in a circle, and no deeper than MAX_CALL_DEPTH.  An END_LOOP
+// outside of the subroutine's own loops makes it bad, as it would end a
+// loop of the caller.  A bad common recipe leaves no subroutines defined.
+//
+// Parameters:  recipe         RECIPE_SIZE command bytes.
+//              program        Where to put the RECIPE_SIZE decoded instructions.
+//
+// Return: TRUE if the recipe was loaded, otherwise FALSE.
+//*****************************************************************************
+UINT8 loadCommon(const UINT8* recipe, struct Instruction* program)
+{
+   UINT8 count;
+   UINT8 index = 0;
+   UINT8 end;
+
+   for(count = 0; count < MAX_SUBROUTINES; count++)
+   {
+      subroutines[count].entry = 0;
+   }
+
+   for(count = 0; firstThree(recipe[index]) != RECIPE_END; count++)
+   {
+      if(count == MAX_SUBROUTINES)
+      {
+         end = RECIPE_SIZE;
+      }
+      else
+      {
+         end = decodeRecipe(recipe, program, index, &subroutines[count]);
+      }
+
+      if(end >= RECIPE_SIZE - 1)
+      {
+         // No room for the RECIPE_END either.
+         for(count = 0; count < MAX_SUBROUTINES; count++)
+         {
+            subroutines[count].entry = 0;
+         }
+
+         PutString("\r\nloadCommon: bad common recipe\r\n");
+
+         return FALSE;
+      }
+
+      // Only now can the subroutines after it call it.
+      subroutines[count].entry = &program[index];
+      index = end + 1;
+   }
+
+   return TRUE;
+}
+
+//*****************************************************************************
+// Decodes a recipe buffer into a program of instructions and points the
+// servo at its first instruction.  Every LOOP_START, BREAK_LOOP and CALL
+// gets its jump target here, so a recipe with a LOOP_START that is never
+// closed, loops nested more than MAX_LOOP_DEPTH deep, a BREAK_LOOP
+// outside of a loop, a CALL of a subroutine loadCommon did not define,
+// a RET or no RECIPE_END is refused now instead of running off the end
+// of the buffer later, as is a fine MOV without its position or to one
+// past MAX_FINE_POSITION.  A refused recipe leaves the servo in the error
+// state.
+//
+// Parameters:  servo          The servo that will run the recipe.
+//              recipe         RECIPE_SIZE command bytes.
+//              program        Where to put the RECIPE_SIZE decoded instructions.
+//
+// Return: TRUE if the recipe was loaded, otherwise FALSE.
+//*****************************************************************************
+UINT8 loadRecipe(struct TaskControlBlock* servo, const UINT8* recipe, struct Instruction* program)
+{
+   if(decodeRecipe(recipe, program, 0, 0) >= RECIPE_SIZE)
+   {
+      // Leave nothing runnable behind.
+      program[0].command = RECIPE_END;
+      servo->program = program;
+      servo->currentCommand = program;
+      servo->status = error;
+
+      PutString("\r\nloadRecipe: bad recipe for servo");
+      TERMIO_PutChar((INT8)servo->channel->name);
+      PutString("\r\n");
+      halLedPut(halLedGet() | servo->channel->ledCommandError);
+
+      return FALSE;
+   }
+
+   servo->program = program;
+   servo->currentCommand = program;
+   servo->staged = 0;
+
+   return TRUE;
+}
+
+//*****************************************************************************
+// Decodes a recipe buffer for a servo to switch to at its next
+// instruction.  The servo carries on with the recipe it is running until
+// then, and for good if the new one is refused.  The recipe is checked
+// in a scratch program first, so a refused one leaves program, and a
+// recipe already staged there, as they were.
+//
+// Parameters:  servo          The servo that will run the recipe.
+//              recipe         RECIPE_SIZE command bytes.
+//              program        Where to put the RECIPE_SIZE decoded
+//                             instructions, not the servo's program.
+//
+// Return: TRUE if the recipe was staged, otherwise FALSE.
+//*****************************************************************************
+UINT8 stageRecipe(struct TaskControlBlock* servo, const UINT8* recipe, struct Instruction* program)
+{
+   // The jumps point into the program they are decoded in, so a good
+   // recipe is decoded again where it is to run from.
+   static struct Instruction scratch[RECIPE_SIZE];
+
+   if(decodeRecipe(recipe, scratch, 0, 0) >= RECIPE_SIZE)
+   {
+      PutString("\r\nstageRecipe: bad recipe for servo");
+      TERMIO_PutChar((INT8)servo->channel->name);
+      PutString("\r\n");
+
+      return FALSE;
+   }
+
+   (void)decodeRecipe(recipe, program, 0, 0);
+   servo->staged = program;
+
+   return TRUE;
+}
+
+//*****************************************************************************
+// Runs the next instruction of a servo that is ready for it, after
+// switching to its staged recipe if it has one.  The switch starts the
+// new recipe from its first command with no loops or calls open.
+//
+// Parameters:  servo          The servo.
+//
+// Return: None.
+//*****************************************************************************
+void runNextCommand(struct TaskControlBlock* servo)
+{
+   if(servo->staged != 0)
+   {
+      servo->program = servo->staged;
+      servo->currentCommand = servo->staged;
+      servo->staged = 0;
+      servo->loopDepth = 0;
+      servo->callDepth = 0;
+
+      traceEvent(TRACE_SWITCH, traceServo(servo), 0);
+   }
+
+   processCommand(servo, servo->currentCommand->command, servo->currentCommand->context);
+}
+
+//*****************************************************************************
+// Decodes one servo recipe, up to its RECIPE_END, or one subroutine of
+// the common recipe, up to its RET, and resolves the jumps in it.
+//
+// Parameters:  recipe         RECIPE_SIZE command bytes.
+//              program        The RECIPE_SIZE decoded instructions.
+//              first          Index of the first command to decode.
+//              subroutine     The subroutine being decoded, whose depths
+//                             are filled in, or 0 for a servo recipe.
+//
+// Return: Index of the RECIPE_END or RET, or RECIPE_SIZE if the commands
+//         are not a good recipe or subroutine.
+//*****************************************************************************
+static UINT8 decodeRecipe(const UINT8* recipe, struct Instruction* program, UINT8 first,
+                          struct Subroutine* subroutine)
+{
+   struct Instruction* openLoops[MAX_LOOP_DEPTH];
+   struct Subroutine* callee;
+   UINT8 last = (subroutine == 0) ? RECIPE_END : RET;
+   UINT8 depth = 0;
+   UINT8 deepestLoop = 0;
+   UINT8 deepestCall = 0;
+   UINT8 index;
+
+   for(index = first; index < RECIPE_SIZE; index++)
+   {
+      program[index].command = firstThree(recipe[index]);
+      program[index].context = lastFive(recipe[index]);
+      program[index].target = &program[index + 1];
+
+      if(program[index].command == last)
+      {
+         break;
+      }
+
+      if(program[index].command == RECIPE_END || program[index].command == RET)
+      {
+         return RECIPE_SIZE;
+      }
+
+      if(program[index].command == LOOP_START)
+      {
+         if(depth == MAX_LOOP_DEPTH)
+         {
+            return RECIPE_SIZE;   // Too deep to pair up.
+         }
+         openLoops[depth] = &program[index];
+         depth++;
+         if(depth > deepestLoop)
+         {
+            deepestLoop = depth;
+         }
+      }
+      else if(program[index].command == END_LOOP && depth > 0)
+      {
+         depth--;
+         openLoops[depth]->target = &program[index + 1];
+      }
+      else if(program[index].command == END_LOOP && subroutine != 0)
+      {
+         // An END_LOOP without a LOOP_START just falls through in a
+         // servo recipe, but in a subroutine it would close a loop of
+         // the caller, whose frames are on the same loop stack.
+         return RECIPE_SIZE;
+      }
+      else if(program[index].command == BREAK_LOOP)
+      {
+         if(depth == 0)
+         {
+            return RECIPE_SIZE;
+         }
+         // Remember the loop for now, its END_LOOP is not known yet.
+         program[index].target = openLoops[depth - 1];
+      }
+      else if(program[index].command == CALL)
+      {
+         callee = &subroutines[program[index].context];
+         if(callee->entry == 0 || depth + callee->loopDepth > MAX_LOOP_DEPTH)
+         {
+            return RECIPE_SIZE;
+         }
+         if(depth + callee->loopDepth > deepestLoop)
+         {
+            deepestLoop = depth + callee->loopDepth;
+         }
+         if(callee->callDepth > deepestCall)
+         {
+            deepestCall = callee->callDepth;
+         }
+         program[index].target = callee->entry;
+      }
+      else if(program[index].command == MOV && program[index].context == FINE_MOV)
+      {
+         if(index + 1 == RECIPE_SIZE || recipe[index + 1] > MAX_FINE_POSITION)
+         {
+            return RECIPE_SIZE;
+         }
+         // The position is not a command, it is kept for processMov in an
+         // instruction the fine MOV steps over and nothing jumps to.
+         program[index].target = &program[index + 2];
+         index++;
+         program[index].command = MOV;
+         program[index].context = recipe[index];
+         program[index].target = &program[index + 1];
+      }
+   }
+
+   if(index >= RECIPE_SIZE || depth > 0)
+   {
+      return RECIPE_SIZE;
+   }
+
+   if(subroutine != 0)
+   {
+      if(deepestCall == MAX_CALL_DEPTH)
+      {
+         return RECIPE_SIZE;
+      }
+      subroutine->loopDepth = deepestLoop;
+      subroutine->callDepth = deepestCall + 1;
+   }
+
+   // Now every loop is closed point each BREAK_LOOP past its END_LOOP.
+   last = index;
+   for(index = first; index < last; index++)
+   {
+      if(program[index].command == BREAK_LOOP)
+      {
+         program[index].target = program[index].target->target;
+      }
+   }
+
+   return last;
+}
+
+//*****************************************************************************
+// This unmitigated piece of crap will process the commands that make up a
+// recipie.
+//
+// Parameters:  servo          Holds a pointer to the servos Task Control Block.
+//              command        The Command to be executed by the servo.
+//              commandContext The context of the comamnd extracted fromt the one
+//                             byte command.
+//
+// Return: None
+//*****************************************************************************
+void processCommand (struct TaskControlBlock* servo, enum COMMANDS command, UINT8 commandContext)
+{
+  traceEvent(TRACE_COMMAND, traceServo(servo), (UINT8)(command | commandContext));
+  commandHandlers[(UINT8)command >> 5](servo, commandContext);
+}
+
+// RECIPE_END: turn the servo off and stop processing its recipe.
+//--------------------------------------------------------------
+static void processRecipeEnd(struct TaskControlBlock* servo, UINT8 commandContext)
+{
+  (void)commandContext;
+
+  // Turn off this servo only.
+  halPwmSetEnable(halPwmGetEnable() & (UINT8)~servo->channel->pwmEnableMask);
+
+  // Set the status LED for this commands.
+  halLedPut(halLedGet() | servo->channel->ledRecipeEnd);
+
+  // Flag is set for reciepe end so that the servo will not process any more commands.
+  servo->recipeEnd = 1;
+}
+
+// MOV: send the servo to a position 0-5, or a fine MOV to the fine
+// position after it.  Positions are kept in fine steps.
+//--------------------------------------------------------------
+static void processMov(struct TaskControlBlock* servo, UINT8 commandContext)
+{
+  UINT16 positionChange = 0;
+  UINT8 position;
+
+  // Check to make sure the command is valid.
+  // The positions are 0-5, loadRecipe has checked a fine one.
+  if(commandContext == FINE_MOV)
+  {
+     position = servo->currentCommand[1].context;
+  }
+  else if(commandContext < 6)
+  {
+     position = (UINT8)(commandContext * FINE_STEPS_PER_POSITION);
+  }
+  else
+  {
+     return;
+  }
+
+  // update the expected servo position
+  servo->expectedServoPosition = position;
+
+  // Calculate out the amount of time it will take the command
+  // to run.
+  if(servo->currentServoPosition == 255)
+  {
+     positionChange =  position;
+  }
+  else if(servo->expectedServoPosition < servo->currentServoPosition)
+  {
+     positionChange = servo->currentServoPosition - servo->expectedServoPosition;
+  }
+  else
+  {
+     positionChange = servo->expectedServoPosition - servo->currentServoPosition;
+  }
+
+  startTimer(servo, positionChange * FINE_STEP_MS);
+
+  // Send the commands down the servo's PWM channel.
+#ifndef PWM_16BIT
+  halPwmSetDuty(servo->channel->pwmChannel, (UINT8)positionDuty(position));
+#else
+  halPwmSetDuty16(servo->channel->pwmChannel, positionDuty(position));
+#endif
+  halPwmSetEnable(halPwmGetEnable() | servo->channel->pwmEnableMask);
+
+  // Update the Task Control Block Status.  A fine MOV goes on after
+  // its position.
+  servo->status = running;
+  servo->currentCommand = servo->currentCommand->target;
+}
+
+// The PWM duty of a fine position, in PWM_CLK_FREQ ticks times
+// PWM_DUTY_SCALE, on the straight line between the servoPositionTicks
+// either side of it and rounded to the nearest.
+//--------------------------------------------------------------
+static UINT16 positionDuty(UINT8 position)
+{
+  UINT8 below = (UINT8)(position / FINE_STEPS_PER_POSITION);
+  UINT8 step = (UINT8)(position % FINE_STEPS_PER_POSITION);
+  UINT16 duty = (UINT16)(servoPositionTicks[below] * PWM_DUTY_SCALE);
+
+  if(step != 0)
+  {
+     duty += (UINT16)(((servoPositionTicks[below + 1] - servoPositionTicks[below]) *
+                       PWM_DUTY_SCALE * step + FINE_STEPS_PER_POSITION / 2) /
+                      FINE_STEPS_PER_POSITION);
+  }
+
+  return duty;
+}
+
+// WAIT: do nothing for 0-31 units of 100ms.
+//--------------------------------------------------------------
+static void processWait(struct TaskControlBlock* servo, UINT8 commandContext)
+{
+  // Calculate out the amount of time it will take the command
+  // to run.  The context is five bits so it is always 0-31.
+  startTimer(servo, commandContext * WAIT_TIME_INCREMENT_MS);
+
+  // increment the command buffer;
+  servo->currentCommand++;
+
+  servo->status = running;
+}
+
+// LOOP_START: run the commands up to the END_LOOP context+1 times.
+// Loops can be nested MAX_LOOP_DEPTH deep.
+//--------------------------------------------------------------
+static void processLoopStart(struct TaskControlBlock* servo, UINT8 commandContext)
+{
+  struct LoopFrame* loop;
+
+  // if there is room for another loop set things up for it.
+  if(servo->loopDepth < MAX_LOOP_DEPTH)
+  {
+     loop = &servo->loops[servo->loopDepth];
+     servo->loopDepth++;
+
+     // Set the number of iterations.
+     loop->counter = commandContext;
+
+     // Increment the instruction pointer, END_LOOP comes back here.
+     servo->currentCommand++;
+     loop->target = servo->currentCommand;
+  }
+  else
+  {
+     // place the task in an error state.
+     servo->status = error;
+
+     // indicate an error for that servo.
+     PutString("\r\nprocessCommand: Loop Too Deep Error for servo");
+     TERMIO_PutChar((INT8)servo->channel->name);
+     PutString("\r\n");
+     halLedPut(halLedGet() | servo->channel->ledLoopError);        // Reciepy command error.
+  }
+}
+
+// END_LOOP: go round the innermost loop again or carry on after it.
+// An END_LOOP outside of any loop just falls through.
+//--------------------------------------------------------------
+static void processEndLoop(struct TaskControlBlock* servo, UINT8 commandContext)
+{
+  struct LoopFrame* loop;
+
+  (void)commandContext;
+
+  if(servo->loopDepth == 0)
+  {
+     servo->currentCommand++;
+     return;
+  }
+  loop = &servo->loops[servo->loopDepth - 1];
+
+  // if we are not on our last iteration of the loop
+  if(loop->counter > 0)
+  {
+     // Go back to the instruction after the LOOP_START command.
+     servo->currentCommand = loop->target;
+
+     // deincrement the loop counter.
+     --(loop->counter);
+  }
+  else
+  {
+     // Ok we're done with the loop.  Clean up the TCB and
+     // go to the next instruction.
+     servo->loopDepth--;
+     servo->currentCommand++;
+  }
+}
+
+// BREAK_LOOP: leave the innermost loop straight away.
+//--------------------------------------------------------------
+static void processBreakLoop(struct TaskControlBlock* servo, UINT8 commandContext)
+{
+  (void)commandContext;
+
+  // clean up the TCB since were out of the loop.
+  if(servo->loopDepth > 0)
+  {
+     servo->loopDepth--;
+  }
+
+  // Jump to the command after the END_LOOP.
+  servo->currentCommand = servo->currentCommand->target;
+}
+
+// CALL: run subroutine context of the common recipe, then carry on
+// after the CALL.
+//--------------------------------------------------------------
+static void processCall(struct TaskControlBlock* servo, UINT8 commandContext)
+{
+  (void)commandContext;
+
+  // loadRecipe has checked the depth, only swapping recipes can get here
+  // with no room to return.
+  if(servo->callDepth == MAX_CALL_DEPTH)
+  {
+     callError(servo);
+     return;
+  }
+
+  servo->returns[servo->callDepth] = servo->currentCommand + 1;
+  servo->callDepth++;
+
+  // Jump to the subroutine.
+  servo->currentCommand = servo->currentCommand->target;
+}
+
+// RET: go back to the command after the CALL.
+//--------------------------------------------------------------
+static void processRet(struct TaskControlBlock* servo, UINT8 commandContext)
+{
+  (void)commandContext;
+
+  if(servo->callDepth == 0)
+  {
+     callError(servo);
+     return;
+  }
+
+  servo->callDepth--;
+  servo->currentCommand = servo->returns[servo->callDepth];
+}
+
+// A CALL or RET that cannot be carried out.
+//--------------------------------------------------------------
+static void callError(struct TaskControlBlock* servo)
+{
+  // place the task in an error state.
+  servo->status = error;
+
+  PutString("\r\nprocessCommand: Call Error for servo");
+  TERMIO_PutChar((INT8)servo->channel->name);
+  PutString("\r\n");
+  halLedPut(halLedGet() | servo->channel->ledCommandError);        // Recipe command error.
+}
+
+//*****************************************************************************
+// This unmitigated piece of crap updates the amount of time left for a command
+// running on a servo.  If the amount of time has expired then it sets the task
+// status to ready.
+//
+// Parameters: NONE
+//
+// Return: None.
+//*****************************************************************************
+void updateTaskStatus(struct TaskControlBlock* servo)
+{
+   // The output compare or tickWheel counts the time down,
+   // it is up once nothing is armed or held.
+
+   // We are processing a command
+   if(servo->status  == running && servo->deadlineState == DEADLINE_IDLE) {
+
+      // set the servo postion to the expected
+      // position and update the task status to ready.
+      servo->currentServoPosition = servo->expectedServoPosition;
+      servo->status = ready;
+
+      traceEvent(TRACE_READY, traceServo(servo), servo->currentServoPosition);
+   }
+}
+
+//*****************************************************************************
+// Finishes the MOV or WAIT of a servo whose deadline or tick timer has
+// passed and runs its next command straight away.
+//
+// Parameters:  servo          The servo whose time is up.
+//
+// Return: None.
+//*****************************************************************************
+void finishDeadline(struct TaskControlBlock* servo)
+{
+   updateTaskStatus(servo);
+   if(servo->status == ready && servo->recipeEnd != 1)
+   {
+      runNextCommand(servo);
+   }
+}
+
+//*****************************************************************************
+// Moves tickWheel on one tick and finishes every servo whose tick timer
+// expires on it.  Only the expiring servos are looked at.
+//
+// Parameters: NONE
+//
+// Return: None.
+//*****************************************************************************
+void tickTimers(void)
+{
+   struct WheelTimer* timer = wheelTick(&tickWheel);
+   struct TaskControlBlock* servo;
+
+   while(timer != 0)
+   {
+      servo = (struct TaskControlBlock*)timer->owner;
+      timer = timer->next;     // finishDeadline may put the servo back on
+
+      servo->deadlineState = DEADLINE_IDLE;
+      finishDeadline(servo);
+   }
+}
+
+// Starts the time a MOV or WAIT takes, on the servo's output compare
+// channel if it has one or else on tickWheel, rounded up to whole ticks.
+//--------------------------------------------------------------
+static void startTimer(struct TaskControlBlock* servo, UINT16 ms)
+{
+   if(servo->channel->timerChannel != NO_TIMER_CHANNEL)
+   {
+      armDeadline(servo, ms * TIMER_COUNTS_PER_MS);
+   }
+   else
+   {
+      armTickTimer(servo, (ms + TICK_MS - 1) / TICK_MS);
+   }
+}
+
+// Puts a servo on tickWheel for ticks ticks.
+//--------------------------------------------------------------
+static void armTickTimer(struct TaskControlBlock* servo, UINT16 ticks)
+{
+   if(ticks == 0)
+   {
+      wheelRemove(&servo->tickTimer);
+      servo->deadlineState = DEADLINE_IDLE;
+   }
+   else
+   {
+      wheelAdd(&tickWheel, &servo->tickTimer, ticks);
+      servo->deadlineState = DEADLINE_ARMED;
+   }
+}
+
+// Programs a deadline counts timer counts from now.  The timer is only
+// 16 bits, so a longer deadline takes a full turn of the counter for
+// every 65536 counts before the last, partial compare.  Must be called
+// with interrupts enabled.
+//--------------------------------------------------------------
+static void armDeadline(struct TaskControlBlock* servo, UINT32 counts)
+{
+   UINT8 channel = servo->channel->timerChannel;
+
+   halDisableInterrupts();
+
+   if(counts == 0)
+   {
+      halTimerCompareIntDisable(channel);
+      servo->deadlineState = DEADLINE_IDLE;
+   }
+   else
+   {
+      if(counts > 0xFFFF)
+      {
+         // The compare matches again after a full turn.
+         halTimerSetCompare(channel, halTimerNow());
+         servo->deadlineLeft = counts - 0x10000;
+      }
+      else
+      {
+         halTimerSetCompare(channel, halTimerNow() + (UINT16)counts);
+         servo->deadlineLeft = 0;
+      }
+      halTimerCompareAcknowledge(channel);
+      halTimerCompareIntEnable(channel);
+      servo->deadlineState = DEADLINE_ARMED;
+   }
+
+   halEnableInterrupts();
+}
+
+//*****************************************************************************
+// Stops the deadline or tick timer of a servo that is no longer running
+// and starts it again from where it stopped once the servo runs again,
+// so the time of a MOV or WAIT only passes while the servo is running.
+// Call it after changing the status of a servo.  Must be called with
+// interrupts enabled.
+//
+// Parameters:  servo          The servo whose status may have changed.
+//
+// Return: None.
+//*****************************************************************************
+void syncDeadline(struct TaskControlBlock* servo)
+{
+   UINT8 channel = servo->channel->timerChannel;
+   UINT32 remaining;
+
+   if(servo->status == running)
+   {
+      if(servo->deadlineState == DEADLINE_HELD && channel == NO_TIMER_CHANNEL)
+      {
+         armTickTimer(servo, (UINT16)servo->deadlineLeft);
+      }
+      else if(servo->deadlineState == DEADLINE_HELD)
+      {
+         armDeadline(servo, servo->deadlineLeft);
+      }
+   }
+   else if(servo->deadlineState == DEADLINE_ARMED && channel == NO_TIMER_CHANNEL)
+   {
+      servo->deadlineLeft = wheelRemaining(&tickWheel, &servo->tickTimer);
+      wheelRemove(&servo->tickTimer);
+      servo->deadlineState = DEADLINE_HELD;
+   }
+   else if(servo->deadlineState == DEADLINE_ARMED)
+   {
+      halDisableInterrupts();
+
+      remaining = servo->deadlineLeft;
+      if(!halTimerCompareFlag(channel))
+      {
+         // Not matched yet, add what is left of the armed compare.
+         remaining += (UINT16)(halTimerGetCompare(channel) - halTimerNow());
+      }
+      halTimerCompareIntDisable(channel);
+      halTimerCompareAcknowledge(channel);
+
+      servo->deadlineLeft = remaining;
+      servo->deadlineState = DEADLINE_HELD;
+
+      halEnableInterrupts();
+   }
+}
+
+//*****************************************************************************
+// Called from the servo's output compare interrupt.  Either sets up the
+// next compare of a long deadline or, when the deadline has passed,
+// turns the channel interrupt off.
+//
+// Parameters:  servo          The servo whose output compare matched.
+//
+// Return: TRUE if the deadline has passed, otherwise FALSE.
+//*****************************************************************************
+UINT8 deadlineInterrupt(struct TaskControlBlock* servo)
+{
+   UINT8 channel = servo->channel->timerChannel;
+
+   halTimerCompareAcknowledge(channel);
+
+   if(servo->deadlineLeft == 0)
+   {
+      halTimerCompareIntDisable(channel);
+      servo->deadlineState = DEADLINE_IDLE;
+      return TRUE;
+   }
+
+   if(servo->deadlineLeft > 0xFFFF)
+   {
+      // Leave the compare alone, it matches again after a full turn.
+      servo->deadlineLeft -= 0x10000;
+   }
+   else
+   {
+      halTimerSetCompare(channel, halTimerGetCompare(channel) + (UINT16)servo->deadlineLeft);
+      servo->deadlineLeft = 0;
+   }
+
+   return FALSE;
+}
@@ -0,0 +1,186 @@
+/******************************************************************************
+ * recipe.h
+ *
+ * Description:
+ *
+ * Recipe interpreter.  A recipe is a buffer of one byte commands: the top
+ * three bits are the command and the bottom five bits its context.
+ * The one exception is a fine MOV, MOV with the context FINE_MOV, whose
+ * position is the byte after it: 0 to MAX_FINE_POSITION, with
+ * FINE_STEPS_PER_POSITION steps from each of the positions 0-5 to the
+ * next, so MOV 2 goes where a fine MOV to 100 does.
+ * loadRecipe decodes a buffer into instructions once, processCommand runs
+ * one instruction on a servo and updateTaskStatus counts down the time the
+ * running instruction has left.
+ *
+ * A servo that is running can be given its next recipe with stageRecipe.
+ * It is decoded into a second program straight away and runNextCommand
+ * switches the servo over to it in place of the next instruction, so the
+ * servo never stops and never runs a mix of the two.
+ *
+ * Motions several servos share can live once in the common recipe as
+ * subroutines: each runs up to its RET, the first is number 0, and a
+ * CALL's context says which one it runs.  loadCommon decodes the common
+ * recipe; it has to be loaded before any recipe that calls into it.
+ *
+ * A servo with its own output compare channel does not count down on the
+ * tick: MOV and WAIT program their end as a deadline on the channel and
+ * deadlineInterrupt reports when it has passed.  The other servos put
+ * theirs on tickWheel, which tickTimers moves on once per tick.
+ *
+ *****************************************************************************/
+
+#ifndef RECIPE_H
+#define RECIPE_H
+
+#include "types.h"
+#include "timerwheel.h"
+
+// Number of command bytes in a recipe buffer.
+#define RECIPE_SIZE 100
+
+// Deepest LOOP_START nesting a recipe can have, counting the loops in
+// the subroutines it calls.
+#define MAX_LOOP_DEPTH 4
+
+// Deepest CALL nesting: a subroutine can call one more.
+#define MAX_CALL_DEPTH 2
+
+// Subroutines the common recipe can hold, one per CALL context.
+#define MAX_SUBROUTINES 32
+
+// One servo per PWM channel, or with PWM_16BIT one per pair of them.
+#ifndef PWM_16BIT
+#define SERVO_COUNT 8
+#else
+#define SERVO_COUNT 4
+#endif
+
+// ServoChannel.timerChannel of a servo without an output compare channel.
+#define NO_TIMER_CHANNEL 0xFF
+
+// The context of a fine MOV and the positions it can go to.
+#define FINE_MOV 31
+#define FINE_STEPS_PER_POSITION 50
+#define MAX_FINE_POSITION (5 * FINE_STEPS_PER_POSITION)
+
+// These are used to extract the command and
+// any parameters attached to those commands.
+#define firstThree(x) ((x>>5)<<5)
+#define lastFive(y) (y&31)
+
+// Possible Task Statuses.
+enum TASKSTATUS
+{
+  ready = 0,
+  running,
+  error,
+  paused,
+  donothing,
+};
+
+// the order of these commands match the op codes
+// listed in the assignment.
+enum COMMANDS
+{
+  RECIPE_END = 0,
+  MOV = 32,
+  WAIT = 64,
+  LOOP_START = 128,
+  END_LOOP = 160,
+  BREAK_LOOP = 96,
+  CALL = 192,
+  RET = 224
+};
+
+// A recipe command decoded by loadRecipe.  The command and its context
+// are split once at load time and every jump is resolved, so running a
+// command never has to look at the raw byte or scan the recipe.
+struct Instruction
+{
+   UINT8 command;               // firstThree of the command byte
+   UINT8 context;               // lastFive of the command byte
+   struct Instruction* target;  // LOOP_START, BREAK_LOOP: the instruction after the END_LOOP
+                                // CALL: the first instruction of the subroutine
+                                // fine MOV: the instruction after its position,
+                                // which is the context of the one in between
+};
+
+// One loop a servo is in.
+struct LoopFrame
+{
+   UINT8 counter;               // times still to go round after this one
+   struct Instruction* target;  // the instruction after the LOOP_START
+};
+
+// Where the running MOV or WAIT of a servo with a timer channel is.
+enum DEADLINESTATE
+{
+  DEADLINE_IDLE = 0,            // nothing armed, the last one has expired
+  DEADLINE_ARMED,               // the output compare is counting it down
+  DEADLINE_HELD                 // stopped while the servo is not running
+};
+
+// The hardware a servo drives: its PWM channel, the output compare
+// channel that times its commands and its status LEDs on PORTA.
+struct ServoChannel
+{
+   UINT8 pwmChannel;            // PWMDTYx the position goes to, with PWM_16BIT
+                                // the odd channel of the pair
+   UINT8 pwmEnableMask;         // PWME bit for the channel
+   UINT8 timerChannel;          // TCx for its deadlines, or NO_TIMER_CHANNEL
+   UINT8 ledPaused;             // PORTA bits
+   UINT8 ledRecipeEnd;
+   UINT8 ledLoopError;
+   UINT8 ledCommandError;
+   char  name;                  // used in messages
+};
+
+// Holds the information for each task.
+struct TaskControlBlock
+{
+   enum TASKSTATUS status;
+   struct Instruction* program;        // the first command of the servo's recipe
+   struct Instruction* staged;         // the recipe to switch to at the next instruction,
+                                       // 0 if none
+   struct Instruction* currentCommand; // points to the current command in a programServo
+   const struct ServoChannel* channel; // the hardware this servo drives
+   UINT8 recipeEnd;             // Set at RECIPE_END so no more commands are processed.
+
+   // Loop bookkeeping stuff.  loops[loopDepth - 1] is the innermost
+   // loop, END_LOOP and BREAK_LOOP work on it.
+   UINT8 loopDepth;             // loops we're in, 0 if none
+   struct LoopFrame loops[MAX_LOOP_DEPTH]; // each loop will run n+1 times
+
+   // Subroutine bookkeeping stuff.
+   UINT8 callDepth;             // subroutines we're in, 0 if none
+   struct Instruction* returns[MAX_CALL_DEPTH]; // the instruction after each CALL
+
+   // MOV bookkeeping stuff
+   UINT8 currentServoPosition;  // 0-MAX_FINE_POSITION, 255 if not known
+   UINT8 expectedServoPosition; // 0-MAX_FINE_POSITION
+
+   // MOV and WAIT bookkeeping stuff.  A servo with a timer channel
+   // counts down in hardware, the others on tickWheel.
+   volatile UINT8 deadlineState; // enum DEADLINESTATE
+   UINT32 deadlineLeft;         // timer counts to go after the armed compare,
+                                // or all of them (ticks for tickWheel) while held
+   struct WheelTimer tickTimer; // on tickWheel while armed
+};
+
+// The wheel the servos without a timer channel count down on, one slot
+// per OC1 tick.
+extern struct TimerWheel tickWheel;
+
+UINT8 loadCommon(const UINT8* recipe, struct Instruction* program);
+UINT8 loadRecipe(struct TaskControlBlock* servo, const UINT8* recipe, struct Instruction* program);
+UINT8 stageRecipe(struct TaskControlBlock* servo, const UINT8* recipe, struct Instruction* program);
+void runNextCommand(struct TaskControlBlock* servo);
+void processCommand(struct TaskControlBlock* servo, enum COMMANDS command, UINT8 commandContext);
+void updateTaskStatus(struct TaskControlBlock* servo);
+void syncDeadline(struct TaskControlBlock* servo);
+UINT8 deadlineInterrupt(struct TaskControlBlock* servo);
+void finishDeadline(struct TaskControlBlock* servo);
+void tickTimers(void);
+
+#endif // RECIPE_H
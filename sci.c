@@ -0,0 +1,407 @@
+/******************************************************************************
+ * sci.c
+ *
+ * Description:
+ *
+ * SCI0 terminal driver.  TERMIO_PutChar queues characters in a ring buffer
+ * and enables the SCI0 transmit interrupt, SCI0_isr moves them into the
+ * data register whenever it is empty.  TERMIO_PutChar is the only writer of
+ * txHead and SCI0_isr the only writer of txTail, so the two only need to
+ * lock each other out when TX_OVERWRITE moves txTail from the main loop.
+ *
+ * The receive side is the mirror image: SCI0_isr is the only writer of
+ * rxHead and TryGetChar the only writer of rxTail, and both are single
+ * bytes, so the queue needs no locking at all.
+ *
+ *****************************************************************************/
+
+// project includes
+#include "types.h"
+#include "hal.h"
+#include "sci.h"
+
+#define SCI_TX_MASK  ((UINT8)(SCI_TX_BUFFER_SIZE - 1))
+#define SCI_RX_MASK  ((UINT8)(SCI_RX_BUFFER_SIZE - 1))
+
+enum TXOVERFLOW txOverflowPolicy = TX_DROP;
+
+UINT32 txBytesQueued = 0;
+UINT32 txBytesDropped = 0;
+
+static UINT8 txBuffer[SCI_TX_BUFFER_SIZE];
+static volatile UINT8 txHead = 0;    // next free slot, written by TERMIO_PutChar
+static volatile UINT8 txTail = 0;    // next byte to send, written by SCI0_isr
+
+UINT16 rxBytesDropped = 0;
+UINT16 rxOverruns = 0;
+
+UINT16 sciBaudDivisor = 0;
+
+static UINT8 rxBuffer[SCI_RX_BUFFER_SIZE];
+static volatile UINT8 rxHead = 0;    // next free slot, written by SCI0_isr
+static volatile UINT8 rxTail = 0;    // next byte to read, written by TryGetChar
+
+static void queueChar(UINT8 ch);
+
+// The rate the port comes up at has to be one it can keep to.
+STATIC_ASSERT(sciBaudWithinError,
+              SCI_DIVISOR(SCI_BAUD) >= 1 && SCI_DIVISOR(SCI_BAUD) <= SCI_MAX_DIVISOR &&
+              SCI_RATE(SCI_DIVISOR(SCI_BAUD)) * 1000UL >= SCI_BAUD * (1000UL - SCI_MAX_ERROR_PERMILLE) &&
+              SCI_RATE(SCI_DIVISOR(SCI_BAUD)) * 1000UL <= SCI_BAUD * (1000UL + SCI_MAX_ERROR_PERMILLE));
+
+
+// Initializes SCI0 for 8N1, SCI_BAUD, interrupt driven I/O
+// The value for the baud selection registers is determined
+// using the formula:
+//
+// SCI0 Baud Rate = ( BUS_CLK_FREQ ) / ( 16 * SCI0BD[12:0] )
+//--------------------------------------------------------------
+void InitializeSerialPort(void)
+{
+    txHead = 0;
+    txTail = 0;
+    rxHead = 0;
+    rxTail = 0;
+
+    // Set baud rate to ~SCI_BAUD (See above formula)
+    // 8N1 is default, transmitter and receiver are enabled.
+    sciBaudDivisor = (UINT16)SCI_DIVISOR(SCI_BAUD);
+    halSciInit(sciBaudDivisor);
+
+    // Have SCI0_isr queue every character received.
+    halSciRxIntEnable();
+}
+
+
+// Works out the SCI0BD value for a rate at BUS_CLK_FREQ.
+//
+// Parameters: baud   the rate wanted
+//
+// Returns: The divisor, or 0 if the rate it gives is more than
+//          SCI_MAX_ERROR_PERMILLE off or it does not fit SCI0BD.
+//--------------------------------------------------------------
+UINT16 SciDivisor(UINT32 baud)
+{
+    UINT32 divisor;
+    UINT32 actual;
+    UINT32 error;
+
+    if(baud == 0)
+    {
+       return 0;
+    }
+
+    divisor = SCI_DIVISOR(baud);
+    if(divisor == 0 || divisor > SCI_MAX_DIVISOR)
+    {
+       return 0;
+    }
+
+    actual = SCI_RATE(divisor);
+    error = (actual > baud) ? actual - baud : baud - actual;
+    if(error * 1000UL > baud * SCI_MAX_ERROR_PERMILLE)
+    {
+       return 0;
+    }
+
+    return (UINT16)divisor;
+}
+
+
+// Changes the rate of both directions at once.  Whatever is being
+// shifted in or out at the time is garbled, so wait for TxDrained
+// and for the other end to stop sending first.
+//
+// Parameters: divisor   the new SCI0BD value, from SciDivisor
+//--------------------------------------------------------------
+void SetBaudDivisor(UINT16 divisor)
+{
+    sciBaudDivisor = divisor;
+    halSciSetDivisor(divisor);
+}
+
+
+// Tells whether everything queued has gone out, the last stop bit
+// included.
+//
+// Returns: TRUE if the transmit buffer is empty and the line is idle.
+//--------------------------------------------------------------
+UINT8 TxDrained(void)
+{
+    return (txTail == txHead && halSciTxComplete()) ? TRUE : FALSE;
+}
+
+
+// This function is called by printf in order to
+// output data.  The character is queued for SCI0_isr to send
+// so printf never waits for the line.
+//
+// Remember to call InitializeSerialPort() before using printf!
+//
+// Parameters: character to output
+//--------------------------------------------------------------
+void TERMIO_PutChar(INT8 ch)
+{
+    queueChar((UINT8)ch);
+
+    // Let SCI0_isr pick it up.
+    halSciTxIntEnable();
+}
+
+
+// Queues a string for SCI0_isr to send.  Cheaper than printf for text
+// with nothing to format: no format string to parse and the transmit
+// interrupt is enabled once for the whole string.
+//
+// Parameters: text   zero terminated string
+//--------------------------------------------------------------
+void PutString(const char* text)
+{
+    while(*text != '\0')
+    {
+       queueChar((UINT8)*text);
+       text++;
+    }
+
+    halSciTxIntEnable();
+}
+
+
+// Queues an unsigned number in decimal, right aligned in a field of
+// width characters padded with spaces.  A width of 0 or one too small
+// for the number just prints all of its digits.
+//
+// Parameters: value   the number
+//             width   field width, at most 5 is useful
+//--------------------------------------------------------------
+void PutUnsigned(UINT16 value, UINT8 width)
+{
+    UINT8 digits[5];
+    UINT8 count = 0;
+
+    do
+    {
+       digits[count] = (UINT8)('0' + value % 10);
+       value /= 10;
+       count++;
+    } while(value != 0);
+
+    while(width > count)
+    {
+       queueChar(' ');
+       width--;
+    }
+    while(count > 0)
+    {
+       count--;
+       queueChar(digits[count]);
+    }
+
+    halSciTxIntEnable();
+}
+
+
+// Queues count bytes as one block: all of them if the transmit buffer
+// has room, otherwise none, whatever txOverflowPolicy says.  For binary
+// records that must not be cut short or interleaved.
+//
+// Parameters: bytes   the bytes to send
+//             count   how many, less than SCI_TX_BUFFER_SIZE
+//
+// Returns: TRUE if they were queued, FALSE if there was no room.
+//--------------------------------------------------------------
+UINT8 TryPutBytes(const UINT8* bytes, UINT8 count)
+{
+    UINT8 room = (UINT8)((txTail - txHead - 1) & SCI_TX_MASK);
+
+    if(count > room)
+    {
+       return FALSE;
+    }
+
+    while(count > 0)
+    {
+       txBuffer[txHead] = *bytes;
+       txHead = (UINT8)((txHead + 1) & SCI_TX_MASK);
+       txBytesQueued++;
+       bytes++;
+       count--;
+    }
+
+    halSciTxIntEnable();
+
+    return TRUE;
+}
+
+
+// Queues a byte as two upper case hex digits.
+//
+// Parameters: value   the byte
+//--------------------------------------------------------------
+void PutHex(UINT8 value)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    queueChar((UINT8)hexDigits[value >> 4]);
+    queueChar((UINT8)hexDigits[value & 0x0F]);
+
+    halSciTxIntEnable();
+}
+
+
+// Puts one character in the transmit buffer, applying
+// txOverflowPolicy when it is full.  The caller enables the transmit
+// interrupt afterwards.
+//
+// Parameters: ch   character to queue
+//--------------------------------------------------------------
+static void queueChar(UINT8 ch)
+{
+    UINT8 next = (UINT8)((txHead + 1) & SCI_TX_MASK);
+
+    if(next == txTail)
+    {
+       switch(txOverflowPolicy)
+       {
+          case TX_BLOCK:
+             // SCI0_isr makes room one character time from now.
+             halSciTxIntEnable();
+             while(next == txTail)
+             {
+               // Nothing
+             }
+             break;
+
+          case TX_OVERWRITE:
+             // Make room by giving up the oldest character.
+             halDisableInterrupts();
+             if(next == txTail)
+             {
+                txTail = (UINT8)((txTail + 1) & SCI_TX_MASK);
+                txBytesDropped++;
+             }
+             halEnableInterrupts();
+             break;
+
+          default:
+             txBytesDropped++;
+             return;
+       }
+    }
+
+    txBuffer[txHead] = ch;
+    txHead = next;
+    txBytesQueued++;
+}
+
+
+// Takes the oldest received character out of the receive queue
+// without waiting.
+//
+// Parameters: ch   where to store the character
+//
+// Returns: TRUE if a character was stored, FALSE if none is waiting.
+//--------------------------------------------------------------
+UINT8 TryGetChar(UINT8* ch)
+{
+  if(rxTail == rxHead)
+  {
+    return FALSE;
+  }
+
+  *ch = rxBuffer[rxTail];
+  rxTail = (UINT8)((rxTail + 1) & SCI_RX_MASK);
+
+  return TRUE;
+}
+
+
+// Looks at the oldest received character without taking it out
+// of the receive queue.
+//
+// Parameters: ch   where to store the character
+//
+// Returns: TRUE if a character was stored, FALSE if none is waiting.
+//--------------------------------------------------------------
+UINT8 PeekChar(UINT8* ch)
+{
+  if(rxTail == rxHead)
+  {
+    return FALSE;
+  }
+
+  *ch = rxBuffer[rxTail];
+
+  return TRUE;
+}
+
+
+// Waits for a character from the receive queue.
+//
+// Returns: Received character
+//--------------------------------------------------------------
+UINT8 GetChar(void)
+{
+  UINT8 ch;
+
+  while(TryGetChar(&ch) == FALSE)
+  {
+    // Nothing
+  }
+
+  return ch;
+}
+
+
+// SCI0 Interrupt Service Routine
+// Queues the received character, if any, then sends the next queued
+// character when the transmit data register is empty and turns the
+// transmit interrupt off once the buffer has drained.
+//
+// The following line must be added to the Project.prm
+// file in order for this ISR to be placed in the correct
+// location:
+//		VECTOR ADDRESS 0xFFD6 SCI0_isr
+#pragma push
+#pragma CODE_SEG __SHORT_SEG NON_BANKED
+//--------------------------------------------------------------
+HAL_ISR(20, SCI0_isr)
+{
+  UINT8 next;
+
+  if(halSciRxFull())
+  {
+    if(halSciRxOverrun())
+    {
+      rxOverruns++;
+    }
+
+    // Reading the data register clears RDRF and OR.
+    next = (UINT8)((rxHead + 1) & SCI_RX_MASK);
+    if(next != rxTail)
+    {
+      rxBuffer[rxHead] = halSciRead();
+      rxHead = next;
+    }
+    else
+    {
+      (void)halSciRead();
+      rxBytesDropped++;
+    }
+  }
+
+  if(halSciTxEmpty())
+  {
+    if(txTail != txHead)
+    {
+      halSciWrite(txBuffer[txTail]);
+      txTail = (UINT8)((txTail + 1) & SCI_TX_MASK);
+    }
+
+    if(txTail == txHead)
+    {
+      halSciTxIntDisable();
+    }
+  }
+}
+#pragma pop
@@ -0,0 +1,94 @@
+/******************************************************************************
+ * sci.h
+ *
+ * Description:
+ *
+ * SCI0 terminal driver.  PutString, PutUnsigned and PutHex, and printf
+ * through TERMIO_PutChar, put text into a transmit ring buffer that the
+ * SCI0 interrupt drains one byte at a time, so they return as soon as the
+ * text is queued.  The firmware uses the Put functions rather than
+ * printf, they need none of the stdio formatting code.  Received characters
+ * are put in a receive queue by the same interrupt and taken out by the
+ * main loop with TryGetChar or GetChar.
+ *
+ * The port comes up at SCI_BAUD.  SciDivisor works out the SCI0BD value
+ * for any other rate from BUS_CLK_FREQ and SetBaudDivisor switches to it,
+ * see baud.h for how the host asks for that.  The divisor is a whole
+ * number, so a rate is only used if the one it gives is within
+ * SCI_MAX_ERROR_PERMILLE of it.  With the 24 MHz bus every standard rate
+ * from 9600 to 115200 baud is within 0.2%; built with PLL_OFF, on the
+ * 2 MHz bus, 19200 to 115200 are 7 to 8.5% off and only 9600 is used.
+ *
+ *****************************************************************************/
+
+#ifndef SCI_H
+#define SCI_H
+
+#include "types.h"
+#include "clock.h"
+
+// Rate the port comes up at, in baud.
+#ifndef SCI_BAUD
+#define SCI_BAUD  9600UL
+#endif
+
+// Furthest the rate a divisor gives may be from the one asked for, in
+// thousandths.  Both ends of the line may be off, and together they have
+// to stay within about 4% for the receiver to sample every bit in the
+// right place.
+#define SCI_MAX_ERROR_PERMILLE  25
+
+// SCI0BD is 13 bits wide.
+#define SCI_MAX_DIVISOR  8191
+
+// The SCI0BD value nearest to a rate, and the rate a divisor gives.  The
+// SCI divides the bus clock by 16 for each bit.
+#define SCI_DIVISOR(baud)  ((BUS_CLK_FREQ + 8UL * (baud)) / (16UL * (baud)))
+#define SCI_RATE(divisor)  (BUS_CLK_FREQ / (16UL * (divisor)))
+
+// Size of the transmit ring buffer.  Must be a power of two no larger
+// than 256 so the UINT8 indices wrap by masking.  One slot is kept free
+// to tell a full buffer from an empty one.
+#define SCI_TX_BUFFER_SIZE  256
+
+// Size of the receive queue, a power of two no larger than 256.
+#define SCI_RX_BUFFER_SIZE  32
+
+// What TERMIO_PutChar does when the transmit buffer is full.
+enum TXOVERFLOW
+{
+  TX_DROP = 0,      // throw the new character away
+  TX_BLOCK,         // wait for the interrupt to make room
+  TX_OVERWRITE      // throw the oldest queued character away
+};
+
+// Overflow policy, TX_DROP unless changed at run time.  TX_BLOCK must not
+// be used by code that runs with interrupts disabled.
+extern enum TXOVERFLOW txOverflowPolicy;
+
+// Characters accepted into and thrown away from the transmit buffer.
+extern UINT32 txBytesQueued;
+extern UINT32 txBytesDropped;
+
+// Characters lost because the receive queue was full, and because SCI0
+// received a new character before the last one was read (overrun).
+extern UINT16 rxBytesDropped;
+extern UINT16 rxOverruns;
+
+// The SCI0BD value in use.
+extern UINT16 sciBaudDivisor;
+
+void InitializeSerialPort(void);
+UINT16 SciDivisor(UINT32 baud);
+void SetBaudDivisor(UINT16 divisor);
+UINT8 TxDrained(void);
+void TERMIO_PutChar(INT8 ch);
+void PutString(const char* text);
+void PutUnsigned(UINT16 value, UINT8 width);
+void PutHex(UINT8 value);
+UINT8 TryPutBytes(const UINT8* bytes, UINT8 count);
+UINT8 TryGetChar(UINT8* ch);
+UINT8 PeekChar(UINT8* ch);
+UINT8 GetChar(void);
+
+#endif // SCI_H
@@ -0,0 +1,1010 @@
+/******************************************************************************
+ * hal_sim.c
+ *
+ * Description:
+ *
+ * Linux simulation backend of the hardware abstraction layer.  See
+ * hal_sim.h for the model.
+ *
+ *****************************************************************************/
+
+#define HAL_SIM_BACKEND
+
+// system includes
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+// project includes
+#include "types.h"
+#include "hal.h"
+
+// Cost model in bus cycles.
+#define SIM_REG_ACCESS_CYCLES  4   // one load/store plus the loop around it
+#define SIM_ISR_ENTRY_CYCLES   9   // stack the CPU registers and fetch the vector
+#define SIM_ISR_EXIT_CYCLES    8   // RTI
+
+// SCI0SR1 bits.
+#define SCI0SR1_TDRE_MASK      0x80
+#define SCI0SR1_TC_MASK        0x40
+#define SCI0SR1_RDRF_MASK      0x20
+#define SCI0SR1_OR_MASK        0x08
+
+// SCI0CR2 bits.
+#define SCI0CR2_SCTIE_MASK     0x80
+#define SCI0CR2_TCIE_MASK      0x40
+#define SCI0CR2_RIE_MASK       0x20
+#define SCI0CR2_TE_MASK        0x08
+#define SCI0CR2_RE_MASK        0x04
+
+#define SIM_NEVER              UINT64_MAX
+
+// Rate the other end of the line starts at, see halSimSciHostBaud.
+#define SIM_SCI_HOST_BAUD      9600
+
+// How far apart, in thousandths, the two ends' rates can be before every
+// byte is garbled.  A receiver resynchronises on each start bit and
+// samples mid bit, so it takes about half a bit of drift over a frame.
+#define SIM_SCI_TOLERANCE_PERMILLE  45
+
+// What a byte received at the wrong rate turns into.
+#define SIM_SCI_GARBLED        0x00
+
+// The firmware interrupt service routines.
+extern void OC1_isr(void);
+extern void TC2_isr(void);
+extern void TC3_isr(void);
+extern void TC4_isr(void);
+extern void TC5_isr(void);
+extern void TC6_isr(void);
+extern void TC7_isr(void);
+extern void SCI0_isr(void);
+
+static struct HalSimRegisters regs;
+
+static uint64_t simCycles;
+static uint64_t simStopCycle;
+static jmp_buf  simStopJump;
+static int      simRunning;
+static int      simInterruptsEnabled;
+static int      simInIsr;
+static uint64_t simInterruptsTaken;
+
+// Timer state.
+static uint64_t timerStartCycle;
+static uint64_t timerLastTick;
+
+// SCI0 state.
+static UINT8    sciTxHolding;
+static int      sciTxHoldingFull;
+static UINT8    sciTxShifter;
+static uint64_t sciTxDoneCycle;
+static UINT8    sciRxData;
+static struct SimRxByte
+{
+   UINT8    data;
+   int      first;              // the first byte of a halSimSciInject call
+   uint64_t cycle;              // when the stop bit has been received
+}*              sciRxQueue;
+static size_t   sciRxQueueLength;
+static size_t   sciRxQueueHead;
+static size_t   sciRxQueueSize;
+static FILE*    sciEcho;
+static size_t   sciOutputLength;
+static UINT32   sciHostBaud;
+static unsigned long sciFramingErrors;
+static void   (*sciTxHook)(UINT8 ch);
+
+static FILE*    timeline;
+static int    (*simDone)(void);
+static void   (*dutyHook)(UINT8 channel, UINT16 duty);
+static int      simDoneStop;     // simDone, not the time limit, stopped the run
+
+static struct HalSimIsrStats isrStats[HAL_SIM_VECTOR_COUNT];
+static void (*isrOverride[HAL_SIM_VECTOR_COUNT])(void);
+
+static void simRunUntil(uint64_t target);
+
+//*****************************************************************************
+// Returns the vector table entry for an interrupt source.
+//*****************************************************************************
+static void (*simVector(UINT8 vector))(void)
+{
+   if(isrOverride[vector] != 0)
+   {
+      return isrOverride[vector];
+   }
+
+   switch(vector)
+   {
+      case HAL_SIM_VECTOR_TIMER_CH1:
+         return OC1_isr;
+      case HAL_SIM_VECTOR_TIMER_CH2:
+         return TC2_isr;
+      case HAL_SIM_VECTOR_TIMER_CH2 + 1:
+         return TC3_isr;
+      case HAL_SIM_VECTOR_TIMER_CH2 + 2:
+         return TC4_isr;
+      case HAL_SIM_VECTOR_TIMER_CH2 + 3:
+         return TC5_isr;
+      case HAL_SIM_VECTOR_TIMER_CH2 + 4:
+         return TC6_isr;
+      case HAL_SIM_VECTOR_TIMER_CH2 + 5:
+         return TC7_isr;
+      case HAL_SIM_VECTOR_SCI0:
+         return SCI0_isr;
+      default:
+         return 0;
+   }
+}
+
+//*****************************************************************************
+// Timer helpers.
+//*****************************************************************************
+static UINT16 timerPrescale(void)
+{
+   return (UINT16)(1u << (regs.TSCR2 & 0x07));
+}
+
+static int timerEnabled(void)
+{
+   return (regs.TSCR1 & 0x80) != 0;
+}
+
+static uint64_t timerTickAt(uint64_t cycle)
+{
+   return (cycle - timerStartCycle) / timerPrescale();
+}
+
+// First tick after timerLastTick at which the counter equals TCn.
+static uint64_t timerMatchTick(UINT8 channel)
+{
+   UINT16 delta = (UINT16)(regs.TC[channel] - (UINT16)(timerLastTick + 1));
+
+   return timerLastTick + 1 + delta;
+}
+
+static uint64_t timerNextEvent(void)
+{
+   uint64_t next = SIM_NEVER;
+   uint64_t cycle;
+   UINT8 channel;
+
+   if(!timerEnabled())
+   {
+      return SIM_NEVER;
+   }
+
+   for(channel = 0; channel < 8; channel++)
+   {
+      if(regs.TIOS & (1u << channel))
+      {
+         cycle = timerStartCycle + timerMatchTick(channel) * timerPrescale();
+         if(cycle < next)
+         {
+            next = cycle;
+         }
+      }
+   }
+
+   return next;
+}
+
+static void timerUpdate(void)
+{
+   uint64_t tick;
+   UINT8 channel;
+
+   if(!timerEnabled())
+   {
+      return;
+   }
+
+   tick = timerTickAt(simCycles);
+   if(tick == timerLastTick)
+   {
+      return;
+   }
+
+   for(channel = 0; channel < 8; channel++)
+   {
+      if((regs.TIOS & (1u << channel)) && timerMatchTick(channel) <= tick)
+      {
+         regs.TFLG1 |= (UINT8)(1u << channel);
+      }
+   }
+
+   timerLastTick = tick;
+}
+
+//*****************************************************************************
+// SCI0 helpers.
+//*****************************************************************************
+static uint64_t sciByteCycles(void)
+{
+   // 10 bits per 8N1 frame, 16 bus clocks per bit per SBR count.
+   return (uint64_t)10 * 16 * regs.SCI0BD;
+}
+
+// The same for the other end, at its own rate.
+static uint64_t sciHostByteCycles(void)
+{
+   return ((uint64_t)10 * HAL_SIM_BUS_CLK_FREQ + sciHostBaud / 2) / sciHostBaud;
+}
+
+// Whether the two ends' rates are close enough for bytes to get through.
+static int sciRatesMatch(void)
+{
+   uint64_t host = (uint64_t)16 * regs.SCI0BD * sciHostBaud;
+   uint64_t drift = host > HAL_SIM_BUS_CLK_FREQ ? host - HAL_SIM_BUS_CLK_FREQ :
+                                                  HAL_SIM_BUS_CLK_FREQ - host;
+
+   return drift * 1000 <= host * SIM_SCI_TOLERANCE_PERMILLE;
+}
+
+static uint64_t sciNextEvent(void)
+{
+   uint64_t next = sciTxDoneCycle;
+
+   if(sciRxQueueHead < sciRxQueueLength && sciRxQueue[sciRxQueueHead].cycle < next)
+   {
+      next = sciRxQueue[sciRxQueueHead].cycle;
+   }
+
+   return next;
+}
+
+static void sciEmit(UINT8 ch)
+{
+   sciOutputLength++;
+
+   if(!sciRatesMatch())
+   {
+      ch = SIM_SCI_GARBLED;
+      sciFramingErrors++;
+   }
+
+   if(sciTxHook != 0)
+   {
+      sciTxHook(ch);
+   }
+
+   if(sciEcho != 0)
+   {
+      fputc(ch, sciEcho);
+   }
+}
+
+static void sciUpdate(void)
+{
+   while(sciTxDoneCycle <= simCycles)
+   {
+      sciEmit(sciTxShifter);
+
+      if(sciTxHoldingFull)
+      {
+         sciTxShifter = sciTxHolding;
+         sciTxHoldingFull = 0;
+         sciTxDoneCycle += sciByteCycles();
+         regs.SCI0SR1 |= SCI0SR1_TDRE_MASK;
+      }
+      else
+      {
+         sciTxDoneCycle = SIM_NEVER;
+         regs.SCI0SR1 |= SCI0SR1_TC_MASK;
+      }
+   }
+
+   while(sciRxQueueHead < sciRxQueueLength && sciRxQueue[sciRxQueueHead].cycle <= simCycles)
+   {
+      if((regs.SCI0CR2 & SCI0CR2_RE_MASK) == 0)
+      {
+         // Receiver off, the byte is lost on the wire.
+      }
+      else if(regs.SCI0SR1 & SCI0SR1_RDRF_MASK)
+      {
+         regs.SCI0SR1 |= SCI0SR1_OR_MASK;
+      }
+      else if(!sciRatesMatch())
+      {
+         sciRxData = SIM_SCI_GARBLED;
+         sciFramingErrors++;
+         regs.SCI0SR1 |= SCI0SR1_RDRF_MASK;
+      }
+      else
+      {
+         sciRxData = sciRxQueue[sciRxQueueHead].data;
+         regs.SCI0SR1 |= SCI0SR1_RDRF_MASK;
+      }
+
+      sciRxQueueHead++;
+   }
+}
+
+//*****************************************************************************
+// Interrupt delivery.
+//*****************************************************************************
+static int simPendingVector(UINT8* vector)
+{
+   UINT8 channel;
+   UINT8 pending = regs.TFLG1 & regs.TIE;
+
+   for(channel = 0; channel < 8; channel++)
+   {
+      if(pending & (1u << channel))
+      {
+         *vector = (UINT8)(HAL_SIM_VECTOR_TIMER_CH0 + channel);
+         return 1;
+      }
+   }
+
+   if(((regs.SCI0CR2 & SCI0CR2_SCTIE_MASK) && (regs.SCI0SR1 & SCI0SR1_TDRE_MASK)) ||
+      ((regs.SCI0CR2 & SCI0CR2_TCIE_MASK) && (regs.SCI0SR1 & SCI0SR1_TC_MASK)) ||
+      ((regs.SCI0CR2 & SCI0CR2_RIE_MASK) &&
+       (regs.SCI0SR1 & (SCI0SR1_RDRF_MASK | SCI0SR1_OR_MASK))))
+   {
+      *vector = HAL_SIM_VECTOR_SCI0;
+      return 1;
+   }
+
+   return 0;
+}
+
+static void simDeliverInterrupts(void)
+{
+   UINT8 vector;
+   void (*isr)(void);
+   uint64_t entry;
+   uint64_t duration;
+
+   while(simInterruptsEnabled && !simInIsr && simPendingVector(&vector))
+   {
+      isr = simVector(vector);
+      if(isr == 0)
+      {
+         fprintf(stderr, "hal_sim: no service routine for vector %u\n", vector);
+         abort();
+      }
+
+      entry = simCycles;
+      simInIsr = 1;
+      simInterruptsTaken++;
+      simRunUntil(simCycles + SIM_ISR_ENTRY_CYCLES);
+      isr();
+      simRunUntil(simCycles + SIM_ISR_EXIT_CYCLES);
+      simInIsr = 0;
+
+      duration = simCycles - entry;
+      isrStats[vector].count++;
+      isrStats[vector].totalCycles += duration;
+      if(duration > isrStats[vector].maxCycles)
+      {
+         isrStats[vector].maxCycles = duration;
+      }
+   }
+}
+
+//*****************************************************************************
+// Advances the virtual clock to target, raising every peripheral event on
+// the way and delivering interrupts when the CPU can take them.
+//*****************************************************************************
+static void simRunUntil(uint64_t target)
+{
+   uint64_t next;
+
+   for(;;)
+   {
+      next = timerNextEvent();
+      if(sciNextEvent() < next)
+      {
+         next = sciNextEvent();
+      }
+
+      if(next > target)
+      {
+         break;
+      }
+
+      simCycles = next;
+      timerUpdate();
+      sciUpdate();
+      simDeliverInterrupts();
+   }
+
+   if(target > simCycles)
+   {
+      simCycles = target;
+      timerUpdate();
+   }
+
+   if(simRunning && simCycles >= simStopCycle)
+   {
+      simRunning = 0;
+      longjmp(simStopJump, 1);
+   }
+}
+
+static void simAccess(void)
+{
+   simRunUntil(simCycles + SIM_REG_ACCESS_CYCLES);
+}
+
+//*****************************************************************************
+// Register accessors.
+//*****************************************************************************
+UINT8 halPwmGetEnable(void)
+{
+   simAccess();
+   return regs.PWME;
+}
+
+void halPwmSetEnable(UINT8 mask)
+{
+   simAccess();
+   if(timeline != 0 && regs.PWME != mask)
+   {
+      fprintf(timeline, "%12.3f ms  PWME     0x%02X\n",
+              simCycles * 1e3 / HAL_SIM_BUS_CLK_FREQ, mask);
+   }
+   regs.PWME = mask;
+}
+
+void halPwmSetDuty(UINT8 channel, UINT8 duty)
+{
+   simAccess();
+   if(timeline != 0 && regs.PWMDTY[channel & 0x07] != duty)
+   {
+      fprintf(timeline, "%12.3f ms  PWMDTY%u  0x%02X\n",
+              simCycles * 1e3 / HAL_SIM_BUS_CLK_FREQ, channel & 0x07, duty);
+   }
+   if(dutyHook != 0 && regs.PWMDTY[channel & 0x07] != duty)
+   {
+      dutyHook((UINT8)(channel & 0x07), duty);
+   }
+   regs.PWMDTY[channel & 0x07] = duty;
+}
+
+// The high byte goes to the even channel of the pair, as on the HCS12.
+void halPwmSetDuty16(UINT8 channel, UINT16 duty)
+{
+   UINT8 high = (UINT8)((channel - 1) & 0x07);
+   UINT8 low = (UINT8)(channel & 0x07);
+   UINT16 old = (UINT16)((regs.PWMDTY[high] << 8) | regs.PWMDTY[low]);
+
+   simAccess();
+   if(timeline != 0 && old != duty)
+   {
+      fprintf(timeline, "%12.3f ms  PWMDTY%u%u 0x%04X\n",
+              simCycles * 1e3 / HAL_SIM_BUS_CLK_FREQ, high, low, duty);
+   }
+   if(dutyHook != 0 && old != duty)
+   {
+      dutyHook(low, duty);
+   }
+   regs.PWMDTY[high] = (UINT8)(duty >> 8);
+   regs.PWMDTY[low] = (UINT8)duty;
+}
+
+UINT8 halLedGet(void)
+{
+   simAccess();
+   return regs.PORTA;
+}
+
+void halLedPut(UINT8 value)
+{
+   simAccess();
+   if(timeline != 0 && regs.PORTA != value)
+   {
+      fprintf(timeline, "%12.3f ms  PORTA    0x%02X\n",
+              simCycles * 1e3 / HAL_SIM_BUS_CLK_FREQ, value);
+   }
+   regs.PORTA = value;
+}
+
+void halTimerAcknowledge(UINT16 period)
+{
+   simAccess();
+   regs.TC[1] = (UINT16)(regs.TC[1] + period);
+   simAccess();
+   regs.TFLG1 &= (UINT8)~0x02;
+}
+
+UINT16 halTimerNow(void)
+{
+   simAccess();
+   return timerEnabled() ? (UINT16)timerLastTick : 0;
+}
+
+UINT16 halTimerGetCompare(UINT8 channel)
+{
+   simAccess();
+   return regs.TC[channel & 0x07];
+}
+
+void halTimerSetCompare(UINT8 channel, UINT16 value)
+{
+   simAccess();
+   regs.TC[channel & 0x07] = value;
+}
+
+UINT8 halTimerCompareFlag(UINT8 channel)
+{
+   simAccess();
+   return (regs.TFLG1 & (1u << (channel & 0x07))) != 0;
+}
+
+void halTimerCompareAcknowledge(UINT8 channel)
+{
+   simAccess();
+   regs.TFLG1 &= (UINT8)~(1u << (channel & 0x07));
+}
+
+void halTimerCompareIntEnable(UINT8 channel)
+{
+   simAccess();
+   regs.TIE |= (UINT8)(1u << (channel & 0x07));
+   simDeliverInterrupts();
+}
+
+void halTimerCompareIntDisable(UINT8 channel)
+{
+   simAccess();
+   regs.TIE &= (UINT8)~(1u << (channel & 0x07));
+}
+
+void halSciSetDivisor(UINT16 divisor)
+{
+   simAccess();
+   regs.SCI0BD = divisor;
+}
+
+UINT8 halSciTxComplete(void)
+{
+   simAccess();
+   return (regs.SCI0SR1 & SCI0SR1_TC_MASK) != 0;
+}
+
+UINT8 halSciTxEmpty(void)
+{
+   simAccess();
+   return (regs.SCI0SR1 & SCI0SR1_TDRE_MASK) != 0;
+}
+
+void halSciTxIntEnable(void)
+{
+   simAccess();
+   regs.SCI0CR2 |= SCI0CR2_SCTIE_MASK;
+   simDeliverInterrupts();
+}
+
+void halSciTxIntDisable(void)
+{
+   simAccess();
+   regs.SCI0CR2 &= (UINT8)~SCI0CR2_SCTIE_MASK;
+}
+
+void halSciWrite(UINT8 ch)
+{
+   simAccess();
+
+   if((regs.SCI0CR2 & SCI0CR2_TE_MASK) == 0 || regs.SCI0BD == 0)
+   {
+      return;
+   }
+
+   regs.SCI0SR1 &= (UINT8)~SCI0SR1_TC_MASK;
+
+   if(sciTxDoneCycle == SIM_NEVER)
+   {
+      sciTxShifter = ch;
+      sciTxDoneCycle = simCycles + sciByteCycles();
+   }
+   else
+   {
+      sciTxHolding = ch;
+      sciTxHoldingFull = 1;
+      regs.SCI0SR1 &= (UINT8)~SCI0SR1_TDRE_MASK;
+   }
+}
+
+UINT8 halSciRxFull(void)
+{
+   simAccess();
+   return (regs.SCI0SR1 & SCI0SR1_RDRF_MASK) != 0;
+}
+
+UINT8 halSciRxOverrun(void)
+{
+   simAccess();
+   return (regs.SCI0SR1 & SCI0SR1_OR_MASK) != 0;
+}
+
+void halSciRxIntEnable(void)
+{
+   simAccess();
+   regs.SCI0CR2 |= SCI0CR2_RIE_MASK;
+   simDeliverInterrupts();
+}
+
+UINT8 halSciRead(void)
+{
+   simAccess();
+   regs.SCI0SR1 &= (UINT8)~(SCI0SR1_RDRF_MASK | SCI0SR1_OR_MASK);
+   return sciRxData;
+}
+
+void halEnableInterrupts(void)
+{
+   simAccess();
+   simInterruptsEnabled = 1;
+   simDeliverInterrupts();
+}
+
+void halDisableInterrupts(void)
+{
+   simAccess();
+   simInterruptsEnabled = 0;
+}
+
+void halWaitForInterrupt(void)
+{
+   uint64_t taken = simInterruptsTaken;
+   uint64_t next;
+
+   simAccess();
+   simInterruptsEnabled = 1;
+   simDeliverInterrupts();
+
+   // The firmware has nothing left to do until the next interrupt, a
+   // good time to see whether the run is over.
+   if(simRunning && simDone != 0 && simDone())
+   {
+      simRunning = 0;
+      simDoneStop = 1;
+      longjmp(simStopJump, 1);
+   }
+
+   // Skip straight to the next peripheral event until one of them
+   // interrupts the CPU.
+   while(simInterruptsTaken == taken)
+   {
+      next = timerNextEvent();
+      if(sciNextEvent() < next)
+      {
+         next = sciNextEvent();
+      }
+      if(next == SIM_NEVER)
+      {
+         next = simStopCycle;
+      }
+      if(next == SIM_NEVER)
+      {
+         fprintf(stderr, "hal_sim: WAI with nothing left to wake it\n");
+         abort();
+      }
+
+      simRunUntil(next);
+   }
+}
+
+//*****************************************************************************
+// Peripheral setup, mirrors hal_hcs12.c.
+//*****************************************************************************
+void halClockInit(void)
+{
+   // The virtual clock runs at BUS_CLK_FREQ from reset.
+   simAccess();
+}
+
+void halPwmInit(void)
+{
+   simAccess();
+   regs.PWME = 0x00;
+   regs.PWMCAE = 0x00;
+   regs.PWMPOL = 0xFF;
+#ifndef PWM_16BIT
+   regs.PWMPRCLK = (UINT8)((PWM_PRESCALE_SHIFT << 4) | PWM_PRESCALE_SHIFT);
+   regs.PWMSCLA = (UINT8)PWM_SCALE;
+   regs.PWMSCLB = (UINT8)PWM_SCALE;
+   regs.PWMCLK = 0xFF;
+   regs.PWMCTL = 0x00;
+   memset(regs.PWMPER, PWM_PERIOD_TICKS, sizeof(regs.PWMPER));
+#else
+   {
+      UINT8 channel;
+
+      regs.PWMPRCLK = (UINT8)((PWM16_PRESCALE_SHIFT << 4) | PWM16_PRESCALE_SHIFT);
+      regs.PWMCLK = 0x00;
+      regs.PWMCTL = 0xF0;
+      for(channel = 0; channel < 8; channel += 2)
+      {
+         regs.PWMPER[channel] = (UINT8)(PWM16_PERIOD_TICKS >> 8);
+         regs.PWMPER[channel + 1] = (UINT8)PWM16_PERIOD_TICKS;
+      }
+   }
+#endif
+}
+
+void halTimerInit(UINT16 firstCompare)
+{
+   simAccess();
+   regs.TSCR2 = (UINT8)((regs.TSCR2 & ~0x07) | TIMER_PRESCALE_SHIFT);
+   regs.TIOS |= 0xFE;
+   regs.TC[1] = firstCompare;
+   regs.TFLG1 &= (UINT8)~0x02;
+   regs.TIE |= 0x02;
+
+   if(!timerEnabled())
+   {
+      regs.TSCR1 |= 0x80;
+      timerStartCycle = simCycles;
+      timerLastTick = 0;
+   }
+}
+
+void halSciInit(UINT16 baudDivisor)
+{
+   simAccess();
+   regs.SCI0BD = baudDivisor;
+   regs.SCI0CR2 |= SCI0CR2_TE_MASK | SCI0CR2_RE_MASK;
+}
+
+void halLedInit(void)
+{
+   simAccess();
+   regs.DDRA = 0xFF;
+}
+
+//*****************************************************************************
+// printf replacement that feeds TERMIO_PutChar.
+//*****************************************************************************
+extern void TERMIO_PutChar(INT8 ch);
+
+int halSimPrintf(const char* format, ...)
+{
+   char text[256];
+   va_list args;
+   int length;
+   int i;
+
+   va_start(args, format);
+   length = vsnprintf(text, sizeof(text), format, args);
+   va_end(args);
+
+   if(length > (int)sizeof(text) - 1)
+   {
+      length = (int)sizeof(text) - 1;
+   }
+
+   for(i = 0; i < length; i++)
+   {
+      TERMIO_PutChar((INT8)text[i]);
+   }
+
+   return length;
+}
+
+//*****************************************************************************
+// Simulator control.
+//*****************************************************************************
+void halSimReset(void)
+{
+   memset(&regs, 0, sizeof(regs));
+   regs.SCI0SR1 = SCI0SR1_TDRE_MASK | SCI0SR1_TC_MASK;
+
+   simCycles = 0;
+   simStopCycle = SIM_NEVER;
+   simRunning = 0;
+   simInterruptsEnabled = 0;
+   simInIsr = 0;
+   simInterruptsTaken = 0;
+
+   timerStartCycle = 0;
+   timerLastTick = 0;
+
+   sciTxHoldingFull = 0;
+   sciTxDoneCycle = SIM_NEVER;
+   sciRxQueueLength = 0;
+   sciRxQueueHead = 0;
+   sciOutputLength = 0;
+   sciHostBaud = SIM_SCI_HOST_BAUD;
+   sciFramingErrors = 0;
+
+   memset(isrStats, 0, sizeof(isrStats));
+}
+
+uint64_t halSimCycles(void)
+{
+   return simCycles;
+}
+
+void halSimAdvance(uint64_t cycles)
+{
+   simRunUntil(simCycles + cycles);
+}
+
+// Runs entry on the simulated CPU until it returns or the given number of
+// bus cycles has elapsed.  Returns 1 if the time limit stopped it, 2 if
+// the halSimStopWhen condition did.
+int halSimRun(void (*entry)(void), uint64_t cycles)
+{
+   simStopCycle = simCycles + cycles;
+   simInIsr = 0;
+   simDoneStop = 0;
+
+   if(setjmp(simStopJump) != 0)
+   {
+      simStopCycle = SIM_NEVER;
+      return simDoneStop ? 2 : 1;
+   }
+
+   simRunning = 1;
+   entry();
+   simRunning = 0;
+   simStopCycle = SIM_NEVER;
+
+   return 0;
+}
+
+// Queues bytes to arrive on the SCI0 receiver back to back, at the
+// other end's rate, starting at the given cycle or after the bytes of
+// any call that started before it, whichever is later.  The bytes of
+// calls that start later are moved back to make room, each call's bytes
+// stay together.  Returns the cycle the last of the new bytes has been
+// received on.
+uint64_t halSimSciInject(uint64_t cycle, const char* data, size_t length)
+{
+   size_t at;
+   size_t i;
+
+   if(length == 0)
+   {
+      return cycle;
+   }
+
+   if(sciRxQueueHead == sciRxQueueLength)
+   {
+      sciRxQueueHead = 0;
+      sciRxQueueLength = 0;
+   }
+
+   if(sciRxQueueLength + length > sciRxQueueSize)
+   {
+      sciRxQueueSize = (sciRxQueueLength + length) * 2;
+      sciRxQueue = (struct SimRxByte*)realloc(sciRxQueue,
+                                              sciRxQueueSize * sizeof(*sciRxQueue));
+      if(sciRxQueue == 0)
+      {
+         abort();
+      }
+   }
+
+   // A byte is received a byte time after it starts.
+   at = sciRxQueueLength;
+   for(i = sciRxQueueLength; i > sciRxQueueHead; i--)
+   {
+      if(sciRxQueue[i - 1].first)
+      {
+         if(sciRxQueue[i - 1].cycle <= cycle + sciHostByteCycles())
+         {
+            break;
+         }
+         at = i - 1;
+      }
+   }
+   if(at > sciRxQueueHead && sciRxQueue[at - 1].cycle > cycle)
+   {
+      cycle = sciRxQueue[at - 1].cycle;
+   }
+
+   memmove(&sciRxQueue[at + length], &sciRxQueue[at],
+           (sciRxQueueLength - at) * sizeof(*sciRxQueue));
+   sciRxQueueLength += length;
+
+   for(i = 0; i < length; i++)
+   {
+      cycle += sciHostByteCycles();
+      sciRxQueue[at + i].data = (UINT8)data[i];
+      sciRxQueue[at + i].first = (i == 0);
+      sciRxQueue[at + i].cycle = cycle;
+   }
+
+   for(i = at + length; i < sciRxQueueLength; i++)
+   {
+      if(sciRxQueue[i].cycle < sciRxQueue[i - 1].cycle + sciHostByteCycles())
+      {
+         sciRxQueue[i].cycle = sciRxQueue[i - 1].cycle + sciHostByteCycles();
+      }
+   }
+
+   return sciRxQueue[at + length - 1].cycle;
+}
+
+// Sets the rate the other end of the line sends and receives at, in
+// baud.  Queued bytes not yet on the line go at the new rate, each
+// call's still back to back and none starting earlier than it was going
+// to.  While the firmware's SCI0BD gives a rate more than
+// SIM_SCI_TOLERANCE_PERMILLE away every byte either way arrives as
+// SIM_SCI_GARBLED and counts as a framing error.
+void halSimSciHostBaud(UINT32 baud)
+{
+   uint64_t oldByteCycles = sciHostByteCycles();
+   uint64_t start;
+   size_t i;
+
+   sciHostBaud = baud;
+
+   for(i = sciRxQueueHead; i < sciRxQueueLength; i++)
+   {
+      start = sciRxQueue[i].cycle - oldByteCycles;
+      if(start < simCycles)
+      {
+         continue;
+      }
+      if(i > sciRxQueueHead && (!sciRxQueue[i].first || sciRxQueue[i - 1].cycle > start))
+      {
+         start = sciRxQueue[i - 1].cycle;
+      }
+      sciRxQueue[i].cycle = start + sciHostByteCycles();
+   }
+}
+
+unsigned long halSimSciFramingErrors(void)
+{
+   return sciFramingErrors;
+}
+
+// Calls hook with every byte the other end receives, as it arrives, or
+// never when hook is 0.
+void halSimSciTxHook(void (*hook)(UINT8 ch))
+{
+   sciTxHook = hook;
+}
+
+void halSimSciEcho(FILE* stream)
+{
+   sciEcho = stream;
+}
+
+void halSimTimeline(FILE* stream)
+{
+   timeline = stream;
+}
+
+// Calls hook, with the simulated clock at the time of the write, every
+// time the firmware changes a PWM duty register, or never when hook is 0.
+void halSimDutyHook(void (*hook)(UINT8 channel, UINT16 duty))
+{
+   dutyHook = hook;
+}
+
+// Has halSimRun stop the first time the firmware waits for an interrupt
+// and done returns non-zero, or never when done is 0.
+void halSimStopWhen(int (*done)(void))
+{
+   simDone = done;
+}
+
+size_t halSimSciOutputLength(void)
+{
+   return sciOutputLength;
+}
+
+const struct HalSimRegisters* halSimRegisters(void)
+{
+   return &regs;
+}
+
+// Replaces the firmware service routine for a vector, or restores it when
+// isr is 0.
+void halSimSetVector(UINT8 vector, void (*isr)(void))
+{
+   isrOverride[vector] = isr;
+}
+
+void halSimIsrStats(UINT8 vector, struct HalSimIsrStats* stats)
+{
+   *stats = isrStats[vector];
+}
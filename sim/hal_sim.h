@@ -0,0 +1,137 @@
+/******************************************************************************
+ * hal_sim.h
+ *
+ * Description:
+ *
+ * Linux simulation backend of the hardware abstraction layer.  Included by
+ * hal.h when HOST_SIM is defined.
+ *
+ * The PWM, PORTA, timer and SCI0 registers are modelled in memory and a
+ * virtual bus clock (BUS_CLK_FREQ, same as the board) advances by a fixed number
+ * of cycles on every register access.  Output compare matches and SCI0
+ * byte timing are scheduled against that clock and the firmware interrupt
+ * service routines are called from it, so busy waits, ISR durations and
+ * serial throughput behave as they would on the HCS12.
+ *
+ * Files that are part of the simulator itself (rather than the firmware
+ * being simulated) define HAL_SIM_BACKEND before including hal.h so that
+ * they keep the host printf and main.
+ *
+ *****************************************************************************/
+
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "clock.h"
+
+// Interrupt service routines are plain functions called by the simulator.
+#define HAL_ISR(vector, name)        void name(void)
+
+// Interrupt vector numbers, as used by the "interrupt n" keyword.
+#define HAL_SIM_VECTOR_TIMER_CH0     8
+#define HAL_SIM_VECTOR_TIMER_CH1     9
+#define HAL_SIM_VECTOR_TIMER_CH2     10
+#define HAL_SIM_VECTOR_SCI0          20
+#define HAL_SIM_VECTOR_COUNT         64
+
+// Register accessors, see hal.h.
+UINT8 halPwmGetEnable(void);
+void  halPwmSetEnable(UINT8 mask);
+void  halPwmSetDuty(UINT8 channel, UINT8 duty);
+void  halPwmSetDuty16(UINT8 channel, UINT16 duty);
+UINT8 halLedGet(void);
+void  halLedPut(UINT8 value);
+void  halTimerAcknowledge(UINT16 period);
+UINT16 halTimerNow(void);
+UINT16 halTimerGetCompare(UINT8 channel);
+void  halTimerSetCompare(UINT8 channel, UINT16 value);
+UINT8 halTimerCompareFlag(UINT8 channel);
+void  halTimerCompareAcknowledge(UINT8 channel);
+void  halTimerCompareIntEnable(UINT8 channel);
+void  halTimerCompareIntDisable(UINT8 channel);
+void  halSciSetDivisor(UINT16 divisor);
+UINT8 halSciTxComplete(void);
+UINT8 halSciTxEmpty(void);
+void  halSciTxIntEnable(void);
+void  halSciTxIntDisable(void);
+void  halSciWrite(UINT8 ch);
+UINT8 halSciRxFull(void);
+UINT8 halSciRxOverrun(void);
+void  halSciRxIntEnable(void);
+UINT8 halSciRead(void);
+void  halEnableInterrupts(void);
+void  halDisableInterrupts(void);
+void  halWaitForInterrupt(void);
+
+// The CodeWarrior printf sends every character through TERMIO_PutChar.
+// The simulated printf does the same so its cost shows up on the virtual
+// clock.
+int halSimPrintf(const char* format, ...);
+
+#ifndef HAL_SIM_BACKEND
+#define printf halSimPrintf
+#define main   firmwareMain
+#endif
+
+// Bus clock of the simulated board in Hz.
+#define HAL_SIM_BUS_CLK_FREQ         ((uint64_t)BUS_CLK_FREQ)
+
+// In memory copy of the modelled registers.
+struct HalSimRegisters
+{
+   UINT8  PWME;
+   UINT8  PWMPOL;
+   UINT8  PWMCLK;
+   UINT8  PWMPRCLK;
+   UINT8  PWMCAE;
+   UINT8  PWMCTL;
+   UINT8  PWMSCLA;
+   UINT8  PWMSCLB;
+   UINT8  PWMPER[8];
+   UINT8  PWMDTY[8];
+
+   UINT8  PORTA;
+   UINT8  DDRA;
+
+   UINT8  TSCR1;
+   UINT8  TSCR2;
+   UINT8  TIOS;
+   UINT8  TIE;
+   UINT8  TFLG1;
+   UINT16 TC[8];
+
+   UINT16 SCI0BD;
+   UINT8  SCI0CR2;
+   UINT8  SCI0SR1;
+};
+
+// Timing statistics for one interrupt vector, in bus cycles.
+struct HalSimIsrStats
+{
+   UINT32   count;
+   uint64_t totalCycles;
+   uint64_t maxCycles;
+};
+
+// Simulator control.
+void     halSimReset(void);
+uint64_t halSimCycles(void);
+void     halSimAdvance(uint64_t cycles);
+int      halSimRun(void (*entry)(void), uint64_t cycles);
+uint64_t halSimSciInject(uint64_t cycle, const char* data, size_t length);
+void     halSimSciHostBaud(UINT32 baud);
+unsigned long halSimSciFramingErrors(void);
+void     halSimSciTxHook(void (*hook)(UINT8 ch));
+void     halSimSciEcho(FILE* stream);
+void     halSimTimeline(FILE* stream);
+void     halSimStopWhen(int (*done)(void));
+void     halSimDutyHook(void (*hook)(UINT8 channel, UINT16 duty));
+size_t   halSimSciOutputLength(void);
+const struct HalSimRegisters* halSimRegisters(void);
+void     halSimSetVector(UINT8 vector, void (*isr)(void));
+void     halSimIsrStats(UINT8 vector, struct HalSimIsrStats* stats);
+
+#endif // HAL_SIM_H
@@ -0,0 +1,924 @@
+/******************************************************************************
+ * recipecheck.c
+ *
+ * Description:
+ *
+ * Host tool that checks a recipe before it goes near a servo and works
+ * out how long it runs.  A recipe file holds the command bytes exactly
+ * as the firmware takes them (firstThree is the command, lastFive its
+ * context, and a fine MOV followed by its position, see recipe.h), the
+ * same file simmain -u uploads.
+ *
+ * Everything loadRecipe and loadCommon refuse is reported as an error,
+ * as is what would stop a servo at run time, a MOV to a position other
+ * than 0-5 (it is never carried out and the servo stays on it for good).
+ * An END_LOOP outside of any loop, which the firmware steps over, is a
+ * warning in a servo recipe and an error in a subroutine, where it would
+ * end a loop of the caller.
+ *
+ * The time is worked out by running the recipe the way processCommand
+ * does, loops, breaks and calls included.  A MOV takes 200 ms per
+ * position travelled, 4 ms per fine step, and a WAIT 100 ms per unit;
+ * the next command then starts as soon as it is over.  Every other
+ * command waits for the next 50 ms tick before the command after it
+ * runs, and a MOV or WAIT that takes no time for two, one for runTasks
+ * to see it is over and one to run the next command.  A fine MOV can
+ * end in between two ticks, the command after it then only waits for
+ * the rest of the tick.  Counting from the tick the recipe starts on the
+ * total is exact, give or take the few microseconds the firmware itself
+ * takes per command, for a servo with an output compare channel; G and
+ * H round each MOV and WAIT up to whole ticks.
+ *
+ * With -O it also writes out a shorter recipe that moves the servo to
+ * the same positions at the same times and ends at the same time:
+ *
+ *  - a MOV to the position an earlier MOV of the recipe has already put
+ *    the servo at becomes a WAIT 1, which takes as long and leaves the
+ *    PWM duty alone; the first MOV is always kept, it is the one that
+ *    turns the PWM channel on
+ *  - a fine MOV to one of the positions 0-5 becomes the one byte MOV
+ *  - WAITs in a row are merged, up to 31 units each
+ *  - a loop of nothing but WAITs becomes the WAITs it adds up to, where
+ *    the ticks its LOOP_START and END_LOOPs take come to whole units
+ *
+ * The last three count on every command starting on a tick, so they
+ * are left out for a recipe with a fine MOV to a position in between.
+ * Every MOV that changes the position is kept, each one sets the PWM
+ * duty.  The common recipe is left alone.  The new recipe is checked and run before it is
+ * written and is not written if its moves or its time differ.
+ *
+ * Build on the host with:
+ *
+ *    cc -I. -O2 -o recipecheck sim/recipecheck.c
+ *
+ * Usage: recipecheck [-c common] [-p position] recipe...
+ *        recipecheck [-c common] [-p position] -O out recipe
+ *
+ *    -c   the common recipe the CALLs go to, see recipe.h
+ *    -p   the position, 0-5, the servo is at when the recipe starts; by
+ *         default it is unknown, as after a reset, and the first MOV is
+ *         timed from position 0 the way processMov does
+ *    -O   write the optimized recipe to out
+ *
+ * Exits with 1 if any recipe has an error.
+ *
+ *****************************************************************************/
+
+// The host widths for the firmware's integer types.
+#ifndef HOST_SIM
+#define HOST_SIM
+#endif
+
+// system includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+// project includes
+#include "types.h"
+#include "recipe.h"
+
+// The timing processMov, processWait and OC1 use.
+#define PER_POSITION_INCREMENT_MS  200
+#define FINE_STEP_MS               (PER_POSITION_INCREMENT_MS / FINE_STEPS_PER_POSITION)
+#define WAIT_TIME_INCREMENT_MS     100
+#define TICK_MS                    50
+
+// Position of a servo nothing has been moved to yet.
+#define UNKNOWN_POSITION           255
+
+// Commands run before a recipe is taken to never finish.
+#define MAX_STEPS                  1000000L
+
+// Longest WAIT, its context is five bits.
+#define WAIT_LIMIT                 31
+
+// FNV-1a, for hashing the moves a recipe makes.
+#define FNV_OFFSET                 2166136261UL
+#define FNV_PRIME                  16777619UL
+
+// A recipe file and what checking it found out.
+struct Recipe
+{
+   const char* name;
+   UINT8 bytes[RECIPE_SIZE];
+   int length;                  // bytes read from the file
+   int target[RECIPE_SIZE];     // LOOP_START, BREAK_LOOP: index after the END_LOOP
+                                // CALL: the subroutine number
+};
+
+// A subroutine of the common recipe.
+struct Subroutine
+{
+   int entry;                   // index of its first command
+   int loopDepth;               // deepest loop nesting in it and what it calls
+   int callDepth;               // 1, or 1 more than the deepest it calls
+};
+
+// Where a running recipe is.
+struct Place
+{
+   const struct Recipe* recipe;
+   int index;
+};
+
+// What running a recipe took.
+struct Timing
+{
+   unsigned long commands;
+   unsigned long moveMs;
+   unsigned long waitMs;
+   unsigned long ticks;         // ticks waited for between commands
+   unsigned long tickMs;        // and how long that took
+   unsigned long timeline;      // hash of when each MOV changed the position and to what
+};
+
+static struct Recipe common;
+static struct Subroutine subroutines[MAX_SUBROUTINES];
+static int subroutineCount = 0;
+static int errors = 0;
+
+
+// Prints a problem with a command, counting it as an error unless it is
+// only a warning.
+static void report(const struct Recipe* recipe, int index, int warning, const char* format, ...)
+{
+   va_list args;
+
+   printf("%s:%d: %s: ", recipe->name, index, warning ? "warning" : "error");
+   va_start(args, format);
+   vprintf(format, args);
+   va_end(args);
+   putchar('\n');
+
+   if(!warning)
+   {
+      errors++;
+   }
+}
+
+// Bytes the command at index takes, 2 for a fine MOV and its position.
+static int commandLength(const struct Recipe* recipe, int index)
+{
+   return recipe->bytes[index] == (MOV | FINE_MOV) ? 2 : 1;
+}
+
+// Reads a recipe file.  Returns 0 if it cannot be used.
+static int readRecipe(struct Recipe* recipe, const char* path)
+{
+   FILE* file = fopen(path, "rb");
+
+   memset(recipe, 0, sizeof(*recipe));
+   recipe->name = path;
+   if(file == 0)
+   {
+      perror(path);
+      errors++;
+      return 0;
+   }
+   recipe->length = (int)fread(recipe->bytes, 1, RECIPE_SIZE, file);
+   if(fgetc(file) != EOF)
+   {
+      printf("%s: error: longer than the %d bytes of a recipe buffer\n", path, RECIPE_SIZE);
+      errors++;
+      recipe->length = 0;
+   }
+   fclose(file);
+
+   return 1;
+}
+
+//*****************************************************************************
+// Checks one servo recipe, up to its RECIPE_END, or one subroutine of the
+// common recipe, up to its RET, and resolves its jumps, the same way
+// decodeRecipe in recipe.c does.
+//
+// Parameters:  recipe         The recipe.
+//              first          Index of the first command.
+//              subroutine     The subroutine, whose depths are filled in,
+//                             or 0 for a servo recipe.
+//
+// Return: Index of the RECIPE_END or RET, or -1 if there is an error that
+//         stops the recipe loading.
+//*****************************************************************************
+static int checkBlock(struct Recipe* recipe, int first, struct Subroutine* subroutine)
+{
+   int openLoops[MAX_LOOP_DEPTH];
+   int breaks[RECIPE_SIZE];
+   int breakCount = 0;
+   int depth = 0;
+   int deepestLoop = 0;
+   int deepestCall = 0;
+   int index;
+   UINT8 command;
+   UINT8 context;
+   const struct Subroutine* callee;
+
+   for(index = first; index < recipe->length; index++)
+   {
+      command = (UINT8)firstThree(recipe->bytes[index]);
+      context = (UINT8)lastFive(recipe->bytes[index]);
+
+      switch(command)
+      {
+         case RECIPE_END:
+            if(subroutine != 0)
+            {
+               report(recipe, index, 0, "RECIPE_END before the RET of subroutine %d",
+                      (int)(subroutine - subroutines));
+               return -1;
+            }
+            break;
+
+         case RET:
+            if(subroutine == 0)
+            {
+               report(recipe, index, 0, "RET outside of a subroutine");
+               return -1;
+            }
+            break;
+
+         case MOV:
+            if(context == FINE_MOV)
+            {
+               if(index + 1 >= recipe->length)
+               {
+                  report(recipe, index, 0, "fine MOV without its position");
+                  return -1;
+               }
+               if(recipe->bytes[index + 1] > MAX_FINE_POSITION)
+               {
+                  report(recipe, index, 0, "fine MOV %d: fine positions are 0-%d",
+                         recipe->bytes[index + 1], MAX_FINE_POSITION);
+                  return -1;
+               }
+               index++;
+            }
+            else if(context > 5)
+            {
+               report(recipe, index, 0, "MOV %d: positions are 0-5, the servo would stop here",
+                      context);
+            }
+            break;
+
+         case LOOP_START:
+            if(depth == MAX_LOOP_DEPTH)
+            {
+               report(recipe, index, 0, "LOOP_START nested more than %d deep", MAX_LOOP_DEPTH);
+               return -1;
+            }
+            openLoops[depth] = index;
+            depth++;
+            if(depth > deepestLoop)
+            {
+               deepestLoop = depth;
+            }
+            break;
+
+         case END_LOOP:
+            if(depth == 0 && subroutine != 0)
+            {
+               report(recipe, index, 0, "END_LOOP outside of a loop of subroutine %d",
+                      (int)(subroutine - subroutines));
+               return -1;
+            }
+            if(depth == 0)
+            {
+               report(recipe, index, 1, "END_LOOP outside of a loop is stepped over");
+               break;
+            }
+            depth--;
+            recipe->target[openLoops[depth]] = index + 1;
+            break;
+
+         case BREAK_LOOP:
+            if(depth == 0)
+            {
+               report(recipe, index, 0, "BREAK_LOOP outside of a loop");
+               return -1;
+            }
+            // Its END_LOOP is not known yet, point it at the loop for now.
+            recipe->target[index] = openLoops[depth - 1];
+            breaks[breakCount++] = index;
+            break;
+
+         case CALL:
+            if(context >= subroutineCount ||
+               (subroutine != 0 && context >= subroutine - subroutines))
+            {
+               report(recipe, index, 0, "CALL %d: no subroutine %d %s", context, context,
+                      subroutine != 0 ? "before this one" : "in the common recipe");
+               return -1;
+            }
+            callee = &subroutines[context];
+            if(depth + callee->loopDepth > MAX_LOOP_DEPTH)
+            {
+               report(recipe, index, 0, "CALL %d: its loops nest more than %d deep with these",
+                      context, MAX_LOOP_DEPTH);
+               return -1;
+            }
+            if(depth + callee->loopDepth > deepestLoop)
+            {
+               deepestLoop = depth + callee->loopDepth;
+            }
+            if(callee->callDepth > deepestCall)
+            {
+               deepestCall = callee->callDepth;
+            }
+            recipe->target[index] = context;
+            break;
+      }
+
+      if(command == (subroutine == 0 ? RECIPE_END : RET))
+      {
+         break;
+      }
+   }
+
+   if(index >= recipe->length)
+   {
+      report(recipe, index, 0, "no %s", subroutine == 0 ? "RECIPE_END" : "RET");
+      return -1;
+   }
+   if(depth > 0)
+   {
+      report(recipe, openLoops[depth - 1], 0, "LOOP_START without an END_LOOP");
+      return -1;
+   }
+
+   if(subroutine != 0)
+   {
+      if(deepestCall == MAX_CALL_DEPTH)
+      {
+         report(recipe, first, 0, "subroutine %d calls more than %d deep",
+                (int)(subroutine - subroutines), MAX_CALL_DEPTH);
+         return -1;
+      }
+      subroutine->loopDepth = deepestLoop;
+      subroutine->callDepth = deepestCall + 1;
+   }
+
+   // Every loop is closed, point each BREAK_LOOP past its END_LOOP.
+   while(breakCount > 0)
+   {
+      breakCount--;
+      recipe->target[breaks[breakCount]] = recipe->target[recipe->target[breaks[breakCount]]];
+   }
+
+   return index;
+}
+
+// Checks the common recipe and numbers its subroutines.  Returns 0 if it
+// has an error.
+static int checkCommon(void)
+{
+   int index = 0;
+   int end;
+
+   while(index < common.length && firstThree(common.bytes[index]) != RECIPE_END)
+   {
+      if(subroutineCount == MAX_SUBROUTINES)
+      {
+         report(&common, index, 0, "more than %d subroutines", MAX_SUBROUTINES);
+         return 0;
+      }
+
+      subroutines[subroutineCount].entry = index;
+      end = checkBlock(&common, index, &subroutines[subroutineCount]);
+      if(end < 0)
+      {
+         return 0;
+      }
+      subroutineCount++;
+      index = end + 1;
+   }
+
+   if(index >= common.length)
+   {
+      report(&common, index, 0, "no RECIPE_END");
+      return 0;
+   }
+
+   return 1;
+}
+
+// The milliseconds a run has taken so far.
+static unsigned long totalMs(const struct Timing* timing)
+{
+   return timing->moveMs + timing->waitMs + timing->tickMs;
+}
+
+// Waits for the next tick, and the one after it as well for two, the way
+// runTasks runs the next command.  The ticks come every TICK_MS from the
+// one the recipe started on.
+static void waitForTicks(struct Timing* timing, int ticks)
+{
+   timing->tickMs += TICK_MS - totalMs(timing) % TICK_MS + (ticks - 1) * TICK_MS;
+   timing->ticks += (unsigned long)ticks;
+}
+
+// Adds a MOV to position, starting now, to the hash of a run's moves.
+static void addToTimeline(struct Timing* timing, int position)
+{
+   unsigned long value[2];
+   const unsigned char* bytes = (const unsigned char*)value;
+   size_t index;
+
+   value[0] = totalMs(timing);
+   value[1] = (unsigned long)position;
+   for(index = 0; index < sizeof(value); index++)
+   {
+      timing->timeline = ((timing->timeline ^ bytes[index]) * FNV_PRIME) & 0xFFFFFFFFUL;
+   }
+}
+
+// The WAIT units a WAIT takes; a WAIT 0 takes as long as a WAIT 1.
+static int waitUnits(UINT8 command)
+{
+   return lastFive(command) == 0 ? 1 : lastFive(command);
+}
+
+//*****************************************************************************
+// Runs a checked recipe the way processCommand would and works out how
+// long it takes.
+//
+// Parameters:  recipe         The recipe, checked without errors.
+//              position       Where the servo starts in fine steps,
+//                             UNKNOWN_POSITION if that is not known.
+//              timing         Filled in with what the run took.
+//
+// Return: 1 if the recipe reached its RECIPE_END, 0 if it did not and
+//         that has been reported.
+//*****************************************************************************
+static int runRecipe(const struct Recipe* recipe, int position, struct Timing* timing)
+{
+   struct LoopState
+   {
+      int counter;
+      struct Place target;
+   } loops[MAX_LOOP_DEPTH];
+   struct Place returns[MAX_CALL_DEPTH];
+   struct Place at;
+   int loopDepth = 0;
+   int callDepth = 0;
+   UINT8 command;
+   UINT8 context;
+   int target;
+   int change;
+
+   memset(timing, 0, sizeof(*timing));
+   timing->timeline = FNV_OFFSET;
+   at.recipe = recipe;
+   at.index = 0;
+
+   for(;;)
+   {
+      if(++timing->commands > MAX_STEPS)
+      {
+         printf("%s: error: still running after %ld commands\n", recipe->name, MAX_STEPS);
+         errors++;
+         return 0;
+      }
+
+      command = (UINT8)firstThree(at.recipe->bytes[at.index]);
+      context = (UINT8)lastFive(at.recipe->bytes[at.index]);
+
+      switch(command)
+      {
+         case RECIPE_END:
+            timing->commands--;
+            return 1;
+
+         case MOV:
+            if(context == FINE_MOV)
+            {
+               target = at.recipe->bytes[at.index + 1];
+            }
+            else if(context > 5)
+            {
+               printf("%s: the servo stops at the MOV %d, %lu.%03lu s in\n", recipe->name,
+                      context, totalMs(timing) / 1000, totalMs(timing) % 1000);
+               return 0;
+            }
+            else
+            {
+               target = context * FINE_STEPS_PER_POSITION;
+            }
+            if(target != position)
+            {
+               addToTimeline(timing, target);
+            }
+            change = (position == UNKNOWN_POSITION) ? target : abs(target - position);
+            position = target;
+            if(change == 0)
+            {
+               waitForTicks(timing, 2);
+            }
+            timing->moveMs += (unsigned long)change * FINE_STEP_MS;
+            at.index += commandLength(at.recipe, at.index);
+            break;
+
+         case WAIT:
+            if(context == 0)
+            {
+               waitForTicks(timing, 2);
+            }
+            timing->waitMs += (unsigned long)context * WAIT_TIME_INCREMENT_MS;
+            at.index++;
+            break;
+
+         case LOOP_START:
+            waitForTicks(timing, 1);
+            loops[loopDepth].counter = context;
+            at.index++;
+            loops[loopDepth].target = at;
+            loopDepth++;
+            break;
+
+         case END_LOOP:
+            waitForTicks(timing, 1);
+            if(loopDepth > 0 && loops[loopDepth - 1].counter > 0)
+            {
+               loops[loopDepth - 1].counter--;
+               at = loops[loopDepth - 1].target;
+            }
+            else
+            {
+               if(loopDepth > 0)
+               {
+                  loopDepth--;
+               }
+               at.index++;
+            }
+            break;
+
+         case BREAK_LOOP:
+            waitForTicks(timing, 1);
+            loopDepth--;
+            at.index = at.recipe->target[at.index];
+            break;
+
+         case CALL:
+            waitForTicks(timing, 1);
+            returns[callDepth].recipe = at.recipe;
+            returns[callDepth].index = at.index + 1;
+            callDepth++;
+            at.recipe = &common;
+            at.index = subroutines[context].entry;
+            break;
+
+         default:
+            waitForTicks(timing, 1);
+            callDepth--;
+            at = returns[callDepth];
+            break;
+      }
+   }
+}
+
+// Runs a checked recipe and prints how long it takes.
+//-----------------------------------------------------
+static void timeRecipe(const struct Recipe* recipe, int position)
+{
+   struct Timing timing;
+
+   if(runRecipe(recipe, position, &timing))
+   {
+      printf("%s: %lu commands run in %lu.%03lu s: %lu.%03lu s moving, "
+             "%lu.%03lu s waiting, %lu ticks between commands\n",
+             recipe->name, timing.commands,
+             totalMs(&timing) / 1000, totalMs(&timing) % 1000,
+             timing.moveMs / 1000, timing.moveMs % 1000,
+             timing.waitMs / 1000, timing.waitMs % 1000, timing.ticks);
+   }
+}
+
+// Takes out the bytes from index up to but not including next.
+static void removeBytes(struct Recipe* recipe, int index, int next)
+{
+   memmove(&recipe->bytes[index], &recipe->bytes[next], (size_t)(recipe->length - next));
+   recipe->length -= next - index;
+}
+
+// Replaces each MOV to the position the servo is known to be at already
+// with a WAIT 1.  processMov takes such a MOV as one that takes no time,
+// two ticks, the same as a WAIT 1, and leaves the PWM duty as it is.
+// The position is only known from a MOV earlier in the same run of
+// commands, every loop, break and call makes it unknown again.  Where
+// the servo starts does not count: the recipe's first MOV is the one
+// that turns its PWM channel on, which is off after a reset and after a
+// RECIPE_END.
+//----------------------------------------------------------------------
+static int dropStillMovs(struct Recipe* recipe)
+{
+   int position = UNKNOWN_POSITION;
+   int changed = 0;
+   int index;
+   int target;
+
+   for(index = 0; index < recipe->length; index += commandLength(recipe, index))
+   {
+      switch(firstThree(recipe->bytes[index]))
+      {
+         case MOV:
+            target = (lastFive(recipe->bytes[index]) == FINE_MOV) ? recipe->bytes[index + 1] :
+                     lastFive(recipe->bytes[index]) * FINE_STEPS_PER_POSITION;
+            if(target == position)
+            {
+               if(commandLength(recipe, index) == 2)
+               {
+                  removeBytes(recipe, index + 1, index + 2);
+               }
+               recipe->bytes[index] = WAIT | 1;
+               changed = 1;
+            }
+            position = target;
+            break;
+
+         case WAIT:
+            break;
+
+         default:
+            position = UNKNOWN_POSITION;
+            break;
+      }
+   }
+
+   return changed;
+}
+
+// Replaces each fine MOV to one of the positions 0-5 with the MOV to it,
+// which moves the same way and is a byte shorter.
+//----------------------------------------------------------------------
+static int shortenFineMovs(struct Recipe* recipe)
+{
+   int changed = 0;
+   int index;
+
+   for(index = 0; index < recipe->length; index += commandLength(recipe, index))
+   {
+      if(commandLength(recipe, index) == 2 &&
+         recipe->bytes[index + 1] % FINE_STEPS_PER_POSITION == 0)
+      {
+         recipe->bytes[index] = (UINT8)(MOV | (recipe->bytes[index + 1] / FINE_STEPS_PER_POSITION));
+         removeBytes(recipe, index + 1, index + 2);
+         changed = 1;
+      }
+   }
+
+   return changed;
+}
+
+// Writes WAITs that add up to units, WAIT_LIMIT at a time, at index.
+// Returns how many it wrote.
+static int putWaits(UINT8* bytes, int index, int units)
+{
+   int count = 0;
+
+   while(units > 0)
+   {
+      bytes[index + count] = (UINT8)(WAIT | (units > WAIT_LIMIT ? WAIT_LIMIT : units));
+      units -= WAIT_LIMIT;
+      count++;
+   }
+
+   return count;
+}
+
+// Merges each two WAITs in a row into one, or into a WAIT 31 and what is
+// left over.  A WAIT 0 takes as long as a WAIT 1.  No jump ever lands on
+// the command after a WAIT, so the two always run together.
+//-----------------------------------------------------------------------
+static int mergeWaits(struct Recipe* recipe)
+{
+   int changed = 0;
+   int index;
+   int units;
+   UINT8 pair[2];
+
+   index = 0;
+   while(index + 1 < recipe->length)
+   {
+      if(firstThree(recipe->bytes[index]) == WAIT &&
+         firstThree(recipe->bytes[index + 1]) == WAIT)
+      {
+         units = waitUnits(recipe->bytes[index]) + waitUnits(recipe->bytes[index + 1]);
+         if(putWaits(pair, 0, units) == 1)
+         {
+            // It may merge with the one after it too.
+            recipe->bytes[index] = pair[0];
+            removeBytes(recipe, index + 1, index + 2);
+            changed = 1;
+            continue;
+         }
+         if(memcmp(pair, &recipe->bytes[index], 2) != 0)
+         {
+            memcpy(&recipe->bytes[index], pair, 2);
+            changed = 1;
+         }
+      }
+
+      index += commandLength(recipe, index);
+   }
+
+   return changed;
+}
+
+// Replaces a loop with nothing but WAITs in it by the WAITs it adds up
+// to, where that is a whole number of WAIT units and takes fewer bytes.
+// The LOOP_START and each END_LOOP take a tick, so LOOP_START n around W
+// ms of WAITs runs for 50 + (n + 1) * (W + 50) ms.
+//-----------------------------------------------------------------------
+static int foldLoops(struct Recipe* recipe)
+{
+   int changed = 0;
+   int index;
+   int end;
+   int units;
+   long ms;
+   UINT8 waits[RECIPE_SIZE];
+   int count;
+
+   for(index = 0; index < recipe->length; index += commandLength(recipe, index))
+   {
+      if(firstThree(recipe->bytes[index]) != LOOP_START)
+      {
+         continue;
+      }
+
+      units = 0;
+      for(end = index + 1; end < recipe->length && firstThree(recipe->bytes[end]) == WAIT; end++)
+      {
+         units += waitUnits(recipe->bytes[end]);
+      }
+      if(end == recipe->length || firstThree(recipe->bytes[end]) != END_LOOP)
+      {
+         continue;
+      }
+
+      ms = TICK_MS + (lastFive(recipe->bytes[index]) + 1L) *
+                     (units * WAIT_TIME_INCREMENT_MS + TICK_MS);
+      if(ms % WAIT_TIME_INCREMENT_MS != 0 ||
+         (ms / WAIT_TIME_INCREMENT_MS + WAIT_LIMIT - 1) / WAIT_LIMIT > end - index)
+      {
+         continue;
+      }
+
+      count = putWaits(waits, 0, (int)(ms / WAIT_TIME_INCREMENT_MS));
+      memcpy(&recipe->bytes[index], waits, (size_t)count);
+      removeBytes(recipe, index + count, end + 1);
+      changed = 1;
+   }
+
+   return changed;
+}
+
+// Returns 1 if the recipe has a fine MOV in it.
+static int hasFineMovs(const struct Recipe* recipe)
+{
+   int index;
+
+   for(index = 0; index < recipe->length; index += commandLength(recipe, index))
+   {
+      if(commandLength(recipe, index) == 2)
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+//*****************************************************************************
+// Makes a shorter recipe that moves the servo at the same times to the same
+// positions and takes as long as the one given, then checks that it does.
+//
+// Parameters:  recipe         The recipe, checked without errors.
+//              position       Where the servo starts, UNKNOWN_POSITION if
+//                             that is not known.
+//              path           File to write the new recipe to.
+//
+// Return: None.
+//*****************************************************************************
+static void optimizeRecipe(const struct Recipe* recipe, int position, const char* path)
+{
+   struct Recipe optimized = *recipe;
+   struct Timing before;
+   struct Timing after;
+   FILE* file;
+   int end;
+
+   // Nothing after the RECIPE_END ever runs.
+   for(end = 0; firstThree(optimized.bytes[end]) != RECIPE_END;
+       end += commandLength(&optimized, end))
+   {
+   }
+   optimized.length = end + 1;
+   optimized.name = path;
+
+   (void)shortenFineMovs(&optimized);
+   if(hasFineMovs(&optimized) == 0)
+   {
+      while(dropStillMovs(&optimized) | mergeWaits(&optimized) |
+            foldLoops(&optimized))
+      {
+      }
+   }
+
+   if(checkBlock(&optimized, 0, 0) < 0 ||
+      runRecipe(recipe, position, &before) == 0 ||
+      runRecipe(&optimized, position, &after) == 0 ||
+      totalMs(&before) != totalMs(&after) || before.timeline != after.timeline)
+   {
+      printf("%s: error: the optimized recipe does not run the same, not written\n",
+             recipe->name);
+      errors++;
+      return;
+   }
+
+   file = fopen(path, "wb");
+   if(file == 0 || fwrite(optimized.bytes, 1, (size_t)optimized.length, file) !=
+                   (size_t)optimized.length)
+   {
+      perror(path);
+      errors++;
+   }
+   if(file != 0)
+   {
+      fclose(file);
+   }
+
+   printf("%s: %d bytes, %lu commands run; %s: %d bytes, %lu commands run, "
+          "same moves at the same times\n", recipe->name, recipe->length, before.commands,
+          path, optimized.length, after.commands);
+}
+
+int main(int argc, char* argv[])
+{
+   struct Recipe recipe;
+   int position = UNKNOWN_POSITION;
+   const char* optimizedPath = 0;
+   int arg = 1;
+
+   common.name = "(no common recipe)";
+   common.bytes[0] = RECIPE_END;
+   common.length = 1;
+
+   while(arg + 1 < argc && argv[arg][0] == '-')
+   {
+      if(strcmp(argv[arg], "-c") == 0)
+      {
+         if(readRecipe(&common, argv[arg + 1]) == 0 || checkCommon() == 0)
+         {
+            return 1;
+         }
+      }
+      else if(strcmp(argv[arg], "-p") == 0)
+      {
+         position = atoi(argv[arg + 1]);
+         if(position < 0 || position > 5)
+         {
+            fprintf(stderr, "recipecheck: positions are 0-5\n");
+            return 1;
+         }
+         position *= FINE_STEPS_PER_POSITION;
+      }
+      else if(strcmp(argv[arg], "-O") == 0)
+      {
+         optimizedPath = argv[arg + 1];
+      }
+      else
+      {
+         break;
+      }
+      arg += 2;
+   }
+
+   if(arg >= argc || (optimizedPath != 0 && arg + 1 != argc))
+   {
+      fprintf(stderr, "usage: recipecheck [-c common] [-p position] recipe...\n"
+                      "       recipecheck [-c common] [-p position] -O out recipe\n");
+      return 1;
+   }
+
+   for(; arg < argc; arg++)
+   {
+      int before = errors;
+
+      if(readRecipe(&recipe, argv[arg]) == 0 || recipe.length == 0)
+      {
+         continue;
+      }
+      if(checkBlock(&recipe, 0, 0) >= 0 && errors == before)
+      {
+         timeRecipe(&recipe, position);
+         if(optimizedPath != 0)
+         {
+            optimizeRecipe(&recipe, position, optimizedPath);
+         }
+      }
+   }
+
+   return errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,364 @@
+/******************************************************************************
+ * simbatch.c
+ *
+ * Description:
+ *
+ * Host batch runner for recipe corpora.  Every recipe file is run the way
+ * the board would run it: a freshly booted simulated HCS12 running the
+ * firmware from main.c gets the recipe as an upload frame for servo A
+ * (see upload.h), servo A is told to continue and the run goes on, on
+ * the virtual clock of hal_sim.c, until servo A reaches its RECIPE_END,
+ * stops on an error or BATCH_LIMIT_S has gone by.  So the results are
+ * those of the firmware's own upload checks, interpreter and timing, not
+ * of a model of them.
+ *
+ * The firmware and the simulator keep their state in globals, so each
+ * recipe gets a process of its own, forked from a worker that has never
+ * run anything.  There is one worker per processor; each takes the next
+ * recipe not yet taken as soon as it is free, so a few long recipes do
+ * not hold up the rest.
+ *
+ * For each recipe one line is printed, in the order given:
+ *
+ *    B.bin: finished in 40.850 s
+ *
+ * then a count of each outcome.  The time is from servo A being told to
+ * continue until it stops.  It is within a tick of what recipecheck
+ * gives, the commands other than MOV and WAIT wait for the next tick and
+ * the key comes in between two.
+ *
+ * Build on the host with:
+ *
+ *    cc -DHOST_SIM -I. -O2 -o simbatch main.c sci.c recipe.c timerwheel.c \
+ *         trace.c upload.c cmdline.c baud.c sim/hal_sim.c sim/simbatch.c
+ *
+ * Usage: simbatch [-j jobs] [-t seconds] recipe...
+ *
+ *    -j   run this many recipes at once, by default one per processor
+ *    -t   give up on a recipe after this many virtual seconds instead
+ *         of BATCH_LIMIT_S
+ *
+ * Exits with 1 if any recipe did not finish.
+ *
+ *****************************************************************************/
+
+#define _DEFAULT_SOURCE
+#define HAL_SIM_BACKEND
+
+// system includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// project includes
+#include "types.h"
+#include "hal.h"
+#include "recipe.h"
+#include "upload.h"
+#include "trace.h"
+
+// Virtual seconds a recipe may run for before it is given up on.
+#ifndef BATCH_LIMIT_S
+#define BATCH_LIMIT_S    3600
+#endif
+
+// When the upload frame and the keys go in, as simmain does it.  "x"
+// is no command at all, servo B stays paused.
+#define UPLOAD_AT_MS     100
+#define KEYS_AT_MS       500
+#define KEYS             "cx"
+#define KEYS_SETTLE_MS   100
+
+#define CYCLES_PER_MS    (HAL_SIM_BUS_CLK_FREQ / 1000)
+
+// What became of a recipe.
+enum BATCHOUTCOME
+{
+  BATCH_FINISHED = 0,           // ran to its RECIPE_END
+  BATCH_ERROR,                  // stopped on a loop or call error
+  BATCH_LIMIT,                  // still running at the limit
+  BATCH_REFUSED,                // the upload was refused
+  BATCH_UNREADABLE,             // no file, or not 1 to RECIPE_SIZE bytes
+  BATCH_CRASHED,                // the process running it died
+  BATCH_OUTCOMES
+};
+
+static const char* const outcomeNames[BATCH_OUTCOMES] =
+{
+   "finished", "stopped on an error", "still running", "refused", "unreadable", "crashed"
+};
+
+// One recipe's result, written by the process that ran it.
+struct BatchResult
+{
+   enum BATCHOUTCOME outcome;
+   int command;                 // BATCH_ERROR: index of the command it stopped on
+   double seconds;              // virtual time it ran for
+};
+
+// Shared between all the processes.
+struct Batch
+{
+   int next;                    // the next recipe no worker has taken
+   struct BatchResult results[1];
+};
+
+extern void firmwareMain(void);
+extern struct TaskControlBlock servos[SERVO_COUNT];
+
+static uint64_t startCycle;
+static UINT8 answer;            // UPLOAD_ACK or UPLOAD_NAK once the frame is answered
+static int recordLeft;
+
+static double hostSeconds(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Picks the answer to the upload frame out of what the firmware sends,
+// leaving out the trace records.
+static void uploadAnswer(UINT8 ch)
+{
+   if(recordLeft > 0)
+   {
+      recordLeft--;
+   }
+   else if(ch & TRACE_SYNC)
+   {
+      recordLeft = TRACE_RECORD_SIZE - 1;
+   }
+   else if(answer == 0 && (ch == UPLOAD_ACK || ch == UPLOAD_NAK))
+   {
+      answer = ch;
+   }
+}
+
+// Tells the simulator the run is over once servo A has finished, and
+// notes when it started.  A refused recipe leaves servo A with the one
+// it had, so the run is over as soon as the NAK is out.  A recipe that
+// is nothing but its RECIPE_END never leaves paused, it is over once the
+// keys are in.
+static int servoDone(void)
+{
+   if(answer == UPLOAD_NAK)
+   {
+      return 1;
+   }
+
+   if(startCycle == 0 &&
+      (servos[0].status != paused ||
+       (servos[0].currentCommand->command == RECIPE_END &&
+        halSimCycles() > (uint64_t)(KEYS_AT_MS + KEYS_SETTLE_MS) * CYCLES_PER_MS)))
+   {
+      startCycle = halSimCycles();
+   }
+
+   return servos[0].recipeEnd != 0 || servos[0].status == error;
+}
+
+//*****************************************************************************
+// Boots the simulated board, uploads a recipe to servo A and runs it.
+//
+// Parameters:  path           The recipe file, raw command bytes.
+//              limit          Virtual seconds to give it.
+//              result         Filled in with what became of it.
+//
+// Return: None.
+//*****************************************************************************
+static void runOne(const char* path, double limit, struct BatchResult* result)
+{
+   UINT8 recipe[RECIPE_SIZE + 1];
+   size_t recipeLength;
+   char frame[RECIPE_SIZE + 4];
+   FILE* file = fopen(path, "rb");
+   size_t index;
+   UINT8 sum;
+   int stopped;
+
+   result->outcome = BATCH_UNREADABLE;
+   if(file == 0)
+   {
+      return;
+   }
+   recipeLength = fread(recipe, 1, sizeof(recipe), file);
+   fclose(file);
+   if(recipeLength == 0 || recipeLength > RECIPE_SIZE)
+   {
+      return;
+   }
+
+   frame[0] = UPLOAD_START;
+   frame[1] = 0;
+   frame[2] = (char)recipeLength;
+   memcpy(&frame[3], recipe, recipeLength);
+   sum = 0;
+   for(index = 1; index < recipeLength + 3; index++)
+   {
+      sum = (UINT8)(sum + (UINT8)frame[index]);
+   }
+   frame[recipeLength + 3] = (char)(UINT8)-sum;
+
+   halSimReset();
+   halSimSciTxHook(uploadAnswer);
+   halSimSciInject((uint64_t)UPLOAD_AT_MS * CYCLES_PER_MS, frame, recipeLength + 4);
+   halSimSciInject((uint64_t)KEYS_AT_MS * CYCLES_PER_MS, KEYS, sizeof(KEYS) - 1);
+   halSimStopWhen(servoDone);
+   stopped = halSimRun(firmwareMain, (uint64_t)((KEYS_AT_MS / 1000.0 + limit) *
+                                                HAL_SIM_BUS_CLK_FREQ));
+
+   result->seconds = startCycle == 0 ? 0.0 :
+                     (double)(halSimCycles() - startCycle) / HAL_SIM_BUS_CLK_FREQ;
+   if(stopped != 2)
+   {
+      result->outcome = BATCH_LIMIT;
+   }
+   else if(answer == UPLOAD_NAK)
+   {
+      result->outcome = BATCH_REFUSED;
+   }
+   else if(servos[0].status == error)
+   {
+      result->outcome = BATCH_ERROR;
+      result->command = (int)(servos[0].currentCommand - servos[0].program);
+   }
+   else
+   {
+      result->outcome = BATCH_FINISHED;
+   }
+}
+
+// Takes recipes until there are none left, running each in a process of
+// its own.
+static void work(struct Batch* batch, int count, char* paths[], double limit)
+{
+   int index;
+   int status;
+   pid_t child;
+
+   while((index = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < count)
+   {
+      child = fork();
+      if(child == 0)
+      {
+         runOne(paths[index], limit, &batch->results[index]);
+         _exit(0);
+      }
+      if(child < 0 || waitpid(child, &status, 0) != child ||
+         !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      {
+         batch->results[index].outcome = BATCH_CRASHED;
+      }
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   struct Batch* batch;
+   size_t size;
+   long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+   double limit = BATCH_LIMIT_S;
+   int totals[BATCH_OUTCOMES] = {0};
+   double virtualSeconds = 0.0;
+   double start;
+   double elapsed;
+   struct BatchResult* result;
+   int count;
+   int index;
+   long worker;
+   int arg = 1;
+
+   while(arg + 1 < argc && argv[arg][0] == '-')
+   {
+      if(strcmp(argv[arg], "-j") == 0)
+      {
+         jobs = atol(argv[arg + 1]);
+      }
+      else if(strcmp(argv[arg], "-t") == 0)
+      {
+         limit = atof(argv[arg + 1]);
+      }
+      else
+      {
+         break;
+      }
+      arg += 2;
+   }
+   count = argc - arg;
+   if(count <= 0 || jobs < 1 || limit <= 0)
+   {
+      fprintf(stderr, "usage: simbatch [-j jobs] [-t seconds] recipe...\n");
+      return 1;
+   }
+   if(jobs > count)
+   {
+      jobs = count;
+   }
+
+   size = sizeof(struct Batch) + (size_t)count * sizeof(struct BatchResult);
+   batch = (struct Batch*)mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                               -1, 0);
+   if(batch == MAP_FAILED)
+   {
+      perror("simbatch");
+      return 1;
+   }
+   memset(batch, 0, size);
+
+   fflush(stdout);
+   start = hostSeconds();
+   for(worker = 0; worker < jobs; worker++)
+   {
+      if(fork() == 0)
+      {
+         work(batch, count, &argv[arg], limit);
+         _exit(0);
+      }
+   }
+   while(wait(0) > 0)
+   {
+   }
+   elapsed = hostSeconds() - start;
+
+   for(index = 0; index < count; index++)
+   {
+      result = &batch->results[index];
+      totals[result->outcome]++;
+      virtualSeconds += result->seconds;
+
+      printf("%s: %s", argv[arg + index], outcomeNames[result->outcome]);
+      switch(result->outcome)
+      {
+         case BATCH_FINISHED:
+            printf(" in %.3f s", result->seconds);
+            break;
+         case BATCH_ERROR:
+            printf(" at command %d after %.3f s", result->command, result->seconds);
+            break;
+         case BATCH_LIMIT:
+            printf(" after %.0f s", limit);
+            break;
+         default:
+            break;
+      }
+      putchar('\n');
+   }
+
+   printf("\n%d recipes on %ld processes, %.1f virtual s in %.3f s (%.0fx real time)\n",
+          count, jobs, virtualSeconds, elapsed, elapsed > 0 ? virtualSeconds / elapsed : 0.0);
+   for(index = 0; index < BATCH_OUTCOMES; index++)
+   {
+      if(totals[index] > 0)
+      {
+         printf("%-20s %d\n", outcomeNames[index], totals[index]);
+      }
+   }
+
+   return totals[BATCH_FINISHED] == count ? 0 : 1;
+}
@@ -0,0 +1,868 @@
+/******************************************************************************
+ * simcheck.c
+ *
+ * Description:
+ *
+ * Host regression check for the recipe interpreter.  Every case is run on
+ * the firmware itself, recipe.c and main.c on the simulated HCS12, and
+ * what it did is compared with what it should have done.  Each case that
+ * does not do it is printed, and the check exits with 1, so it can be run
+ * after every change.
+ *
+ * The subroutine cases load a common recipe and a servo recipe with
+ * loadCommon and loadRecipe and run the servo recipe through
+ * processCommand straight to its RECIPE_END, the time each command takes
+ * left out.  They check the positions its MOVs go to, CALLs in and out of
+ * loops and subroutines calling each other included, and that everything
+ * loadCommon and loadRecipe must refuse is refused: a subroutine calling
+ * itself or one after it, calls nested deeper than MAX_CALL_DEPTH, a RET
+ * outside of a subroutine and a CALL of a subroutine there is not.
+ *
+ * The timing cases are random recipes, the same ones every time, with
+ * MOVs, fine MOVs, WAITs, loops, breaks and CALLs of the firmware's own
+ * common recipe.  Each is uploaded to a freshly booted board the way
+ * simbatch does it and run on the virtual clock from servo A's continue
+ * key to its RECIPE_END, and the time has to be the one recipecheck
+ * gives for it.  recipecheck counts from a tick but the key comes in
+ * after one, so on the board a recipe that ever waits for a tick is
+ * over sooner by the time from that tick to the key and one that never
+ * does takes exactly as long, give or take CHECK_SLACK_MS for the
+ * firmware's own time per command.
+ *
+ * The optimizer cases are more random recipes, half of them without fine
+ * MOVs so every rule of recipecheck -O gets to work on them.  Each is
+ * optimized and the recipe and its optimized one are both run on the
+ * board.  From the key on they have to change the PWM duty, PWME and the
+ * LEDs on PORTA the same way at the same times, as the timelines simmain
+ * -p writes show it.  A same time is one within CHECK_SLACK_MS or within
+ * it of the time from the tick to the key either way, as one of them may
+ * wait for a tick where the other does not.
+ *
+ * Build on the host with:
+ *
+ *    cc -DHOST_SIM -I. -O2 -o simcheck main.c sci.c recipe.c timerwheel.c \
+ *         trace.c upload.c cmdline.c baud.c sim/hal_sim.c sim/simcheck.c
+ *
+ * Usage: simcheck [-n recipes] [recipecheck]
+ *
+ *    -n   run this many random recipes for each of the timing and the
+ *         optimizer cases instead of CHECK_RECIPES
+ *
+ * recipecheck is the one built from the same tree, ./recipecheck by
+ * default.
+ *
+ * Exits with 1 if any case failed.
+ *
+ *****************************************************************************/
+
+#define _DEFAULT_SOURCE
+#define HAL_SIM_BACKEND
+
+// system includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// project includes
+#include "types.h"
+#include "hal.h"
+#include "recipe.h"
+#include "upload.h"
+
+// Longest timeline line.
+#define TIMELINE_LINE    80
+
+// Most MOVs a subroutine case runs.
+#define CASE_MOVES_MAX   32
+
+// Commands run before a subroutine case is taken to never finish.
+#define CASE_STEPS_MAX   1000
+
+// Random recipes the timing and the optimizer cases each run, and the
+// virtual seconds each may take.
+#define CHECK_RECIPES    500
+#define CHECK_LIMIT_S    600
+
+// When the upload frame and servo A's continue key go in, as simbatch
+// does it.
+#define UPLOAD_AT_MS     100
+#define KEYS_AT_MS       500
+
+#define CYCLES_PER_MS    (HAL_SIM_BUS_CLK_FREQ / 1000)
+
+// How far the firmware's time may be from recipecheck's for the time it
+// takes to run the commands themselves.  That is a number of
+// instructions, so it is given in bus cycles, 0.1 ms at the 24 MHz bus
+// and 1.2 ms at the 2 MHz one of PLL_OFF.
+#ifndef CHECK_SLACK_CYCLES
+#define CHECK_SLACK_CYCLES 2400
+#endif
+#define CHECK_SLACK_MS   ((double)CHECK_SLACK_CYCLES / CYCLES_PER_MS)
+
+// A common recipe and a servo recipe, and what loading and running
+// them must do.  The recipes are RECIPE_END after the bytes given.
+struct CallCase
+{
+   const char* name;
+   UINT8 common[RECIPE_SIZE];
+   UINT8 recipe[RECIPE_SIZE];
+   UINT8 commonLoads;           // TRUE if loadCommon must take the common recipe
+   UINT8 recipeLoads;           // TRUE if loadRecipe must take the servo recipe
+   const char* moves;           // the positions its MOVs go to, in order
+};
+
+static const struct CallCase callCases[] =
+{
+   {
+      "CALL inside a loop",
+      { MOV + 1, MOV + 2, RET },
+      { LOOP_START + 2, CALL + 0, MOV + 4, END_LOOP, MOV + 0 },
+      TRUE, TRUE, "1241241240"
+   },
+   {
+      "BREAK_LOOP after a CALL",
+      { MOV + 1, RET },
+      { LOOP_START + 3, CALL + 0, MOV + 2, BREAK_LOOP, MOV + 3, END_LOOP, MOV + 5 },
+      TRUE, TRUE, "125"
+   },
+   {
+      "loop inside a subroutine",
+      { LOOP_START + 1, MOV + 2, MOV + 3, END_LOOP, RET },
+      { LOOP_START + 1, CALL + 0, END_LOOP, MOV + 0 },
+      TRUE, TRUE, "232323230"
+   },
+   {
+      "subroutine calling the one before it",
+      { MOV + 1, RET, CALL + 0, MOV + 3, RET },
+      { CALL + 1, MOV + 5, CALL + 0 },
+      TRUE, TRUE, "1351"
+   },
+   {
+      "calls MAX_CALL_DEPTH deep",
+      { MOV + 1, RET, MOV + 2, CALL + 0, MOV + 3, RET },
+      { CALL + 1, CALL + 1 },
+      TRUE, TRUE, "213213"
+   },
+   {
+      "fine MOV in a subroutine",
+      { MOV + FINE_MOV, 117, RET },
+      { CALL + 0, MOV + 4 },
+      TRUE, TRUE, "24"
+   },
+   {
+      "subroutine calling itself",
+      { MOV + 1, CALL + 0, RET },
+      { MOV + 0 },
+      FALSE, TRUE, "0"
+   },
+   {
+      "subroutine calling the one after it",
+      { CALL + 1, RET, MOV + 1, RET },
+      { MOV + 0 },
+      FALSE, TRUE, "0"
+   },
+   {
+      "calls deeper than MAX_CALL_DEPTH",
+      { MOV + 1, RET, CALL + 0, RET, CALL + 1, RET },
+      { MOV + 0 },
+      FALSE, TRUE, "0"
+   },
+   {
+      "END_LOOP outside of a subroutine's loops",
+      { MOV + 1, END_LOOP, RET },
+      { LOOP_START + 1, CALL + 0, END_LOOP, MOV + 0 },
+      FALSE, FALSE, ""
+   },
+   {
+      "CALL of a subroutine of a refused common recipe",
+      { CALL + 0, RET },
+      { CALL + 0 },
+      FALSE, FALSE, ""
+   },
+   {
+      "CALL of a subroutine there is not",
+      { MOV + 1, RET },
+      { MOV + 0, CALL + 1 },
+      TRUE, FALSE, ""
+   },
+   {
+      "RET outside of a subroutine",
+      { MOV + 1, RET },
+      { MOV + 0, RET, MOV + 1 },
+      TRUE, FALSE, ""
+   },
+   {
+      "RET in a loop outside of a subroutine",
+      { MOV + 1, RET },
+      { LOOP_START + 1, CALL + 0, RET, END_LOOP },
+      TRUE, FALSE, ""
+   },
+   {
+      "loops too deep through a CALL",
+      { LOOP_START + 0, LOOP_START + 0, MOV + 1, END_LOOP, END_LOOP, RET },
+      { LOOP_START + 0, LOOP_START + 0, LOOP_START + 0, CALL + 0, END_LOOP, END_LOOP,
+        END_LOOP },
+      TRUE, FALSE, ""
+   }
+};
+
+#define CALL_CASES  (sizeof(callCases) / sizeof(callCases[0]))
+
+// How a recipe ran on the simulated board.
+struct SimRun
+{
+   int finished;                // reached its RECIPE_END
+   double ms;                   // from servo A's continue key to then
+   double sinceTickMs;          // from the last tick before the key to the key
+};
+
+extern void firmwareMain(void);
+extern void OC1_isr(void);
+extern struct TaskControlBlock servos[SERVO_COUNT];
+extern UINT8 bufferCommon[RECIPE_SIZE];
+extern void initializeServos(void);
+
+static int failures = 0;
+static UINT32 seed = 1;
+static uint64_t keyCycle;
+static uint64_t tickCycle;
+static uint64_t endCycle;
+
+// Prints a case that did not do what it should.
+static void fail(const char* name, const char* what, const char* expected, const char* got)
+{
+   printf("%s: %s, expected %s, got %s\n", name, what, expected, got);
+   failures++;
+}
+
+//*****************************************************************************
+// Loads the recipes of a subroutine case and runs the servo recipe to its
+// RECIPE_END on servo A.
+//
+// Parameters:  check          The case.
+//
+// Return: None, a case that fails is printed and counted.
+//*****************************************************************************
+static void runCallCase(const struct CallCase* check)
+{
+   static struct Instruction common[RECIPE_SIZE];
+   static struct Instruction program[RECIPE_SIZE];
+   struct TaskControlBlock* servo = &servos[0];
+   char moves[CASE_MOVES_MAX + 1];
+   int moveCount = 0;
+   int steps;
+   UINT8 command;
+   UINT8 loaded;
+
+   initializeServos();
+
+   loaded = loadCommon(check->common, common);
+   if(loaded != check->commonLoads)
+   {
+      fail(check->name, "loadCommon", check->commonLoads ? "loaded" : "refused",
+           loaded ? "loaded" : "refused");
+      return;
+   }
+
+   loaded = loadRecipe(servo, check->recipe, program);
+   if(loaded != check->recipeLoads)
+   {
+      fail(check->name, "loadRecipe", check->recipeLoads ? "loaded" : "refused",
+           loaded ? "loaded" : "refused");
+      return;
+   }
+   if(loaded == FALSE)
+   {
+      if(servo->status != error)
+      {
+         fail(check->name, "refused recipe", "the servo in error", "it runnable");
+      }
+      return;
+   }
+
+   servo->status = ready;
+   for(steps = 0; steps < CASE_STEPS_MAX && servo->recipeEnd == 0 && servo->status != error;
+       steps++)
+   {
+      command = servo->currentCommand->command;
+      processCommand(servo, (enum COMMANDS)command, servo->currentCommand->context);
+      if(command == MOV && moveCount < CASE_MOVES_MAX)
+      {
+         moves[moveCount++] = (char)('0' + servo->expectedServoPosition / FINE_STEPS_PER_POSITION);
+      }
+   }
+   moves[moveCount] = '\0';
+
+   if(servo->recipeEnd == 0)
+   {
+      fail(check->name, "run", "its RECIPE_END",
+           servo->status == error ? "an error" : "no end");
+   }
+   else if(servo->callDepth != 0 || servo->loopDepth != 0)
+   {
+      fail(check->name, "run", "no calls or loops open at the end", "some open");
+   }
+   else if(strcmp(moves, check->moves) != 0)
+   {
+      fail(check->name, "MOVs to", check->moves, moves);
+   }
+}
+
+// The next number, 0 to below - 1, from a fixed pseudo random sequence.
+static int randomBelow(int below)
+{
+   seed = seed * 1103515245UL + 12345UL;
+   return (int)((seed >> 16) % (UINT32)below);
+}
+
+//*****************************************************************************
+// Appends one to five random commands to a recipe, loops among them.
+//
+// Parameters:  bytes          The recipe, with room for any length.
+//              length         Bytes in it so far.
+//              depth          How many more loops deep they may go.
+//              fine           Non-zero for fine MOVs among them.
+//
+// Return: Bytes in it now.
+//*****************************************************************************
+static int randomCommands(UINT8* bytes, int length, int depth, int fine)
+{
+   int count = 1 + randomBelow(5);
+   int waits;
+
+   while(count > 0)
+   {
+      count--;
+      switch(randomBelow(depth > 0 ? 10 : 8))
+      {
+         case 0:
+         case 1:
+         case 2:
+            bytes[length++] = (UINT8)(MOV + randomBelow(6));
+            break;
+
+         case 3:
+            if(fine)
+            {
+               bytes[length++] = MOV + FINE_MOV;
+               bytes[length++] = (UINT8)randomBelow(MAX_FINE_POSITION + 1);
+            }
+            else
+            {
+               bytes[length++] = (UINT8)(MOV + randomBelow(6));
+            }
+            break;
+
+         case 4:
+         case 5:
+         case 6:
+            bytes[length++] = (UINT8)(WAIT + randomBelow(8));
+            break;
+
+         case 7:
+            bytes[length++] = CALL + 0;
+            break;
+
+         case 8:
+            bytes[length++] = (UINT8)(LOOP_START + randomBelow(3));
+            length = randomCommands(bytes, length, depth - 1, fine);
+            if(randomBelow(4) == 0)
+            {
+               bytes[length++] = BREAK_LOOP;
+               length = randomCommands(bytes, length, depth - 1, fine);
+            }
+            bytes[length++] = END_LOOP;
+            break;
+
+         default:
+            bytes[length++] = (UINT8)(LOOP_START + randomBelow(4));
+            for(waits = 1 + randomBelow(3); waits > 0; waits--)
+            {
+               bytes[length++] = (UINT8)(WAIT + randomBelow(6));
+            }
+            bytes[length++] = END_LOOP;
+            break;
+      }
+   }
+
+   return length;
+}
+
+// Makes a random recipe that fits a recipe buffer, with fine MOVs or
+// without.  Returns its length.
+static int randomRecipe(UINT8* bytes, int fine)
+{
+   UINT8 scratch[4 * RECIPE_SIZE];
+   int length;
+
+   do
+   {
+      length = randomCommands(scratch, 0, 2, fine);
+      scratch[length++] = RECIPE_END;
+   } while(length > RECIPE_SIZE);
+
+   memcpy(bytes, scratch, (size_t)length);
+   return length;
+}
+
+// Writes bytes to a file.  Returns 0 if it cannot.
+static int writeFile(const char* path, const UINT8* bytes, int length)
+{
+   FILE* file = fopen(path, "wb");
+   int written;
+
+   if(file == 0)
+   {
+      perror(path);
+      return 0;
+   }
+   written = (int)fwrite(bytes, 1, (size_t)length, file);
+   return (fclose(file) == 0 && written == length) ? 1 : 0;
+}
+
+// OC1_isr, noting when the last tick before the key came.
+static void noteTick(void)
+{
+   if(halSimCycles() < keyCycle)
+   {
+      tickCycle = halSimCycles();
+   }
+   OC1_isr();
+}
+
+// Tells the simulator the run is over once servo A has finished, or
+// stopped on an error.
+static int servoDone(void)
+{
+   if(halSimCycles() < keyCycle ||
+      (servos[0].recipeEnd == 0 && servos[0].status != error))
+   {
+      return 0;
+   }
+
+   endCycle = halSimCycles();
+   return 1;
+}
+
+//*****************************************************************************
+// Boots the simulated board in a process of its own, uploads a recipe to
+// servo A, continues it and runs it to its RECIPE_END.
+//
+// Parameters:  recipe         The command bytes.
+//              length         How many.
+//              timeline       File for what halSimTimeline writes, or 0.
+//              run            Filled in with how it ran, shared with the
+//                             process that runs it.
+//
+// Return: None.
+//*****************************************************************************
+static void simulate(const UINT8* recipe, int length, const char* timeline,
+                     struct SimRun* run)
+{
+   char frame[RECIPE_SIZE + 4];
+   FILE* file = 0;
+   UINT8 sum = 0;
+   int index;
+   pid_t child;
+   int status;
+
+   run->finished = 0;
+   run->ms = 0.0;
+   fflush(stdout);
+
+   // A child that crashes leaves the run unfinished.
+   child = fork();
+   if(child != 0)
+   {
+      if(child > 0)
+      {
+         (void)waitpid(child, &status, 0);
+      }
+      return;
+   }
+
+   frame[0] = UPLOAD_START;
+   frame[1] = 0;
+   frame[2] = (char)length;
+   memcpy(&frame[3], recipe, (size_t)length);
+   for(index = 1; index < length + 3; index++)
+   {
+      sum = (UINT8)(sum + (UINT8)frame[index]);
+   }
+   frame[length + 3] = (char)(UINT8)-sum;
+
+   if(timeline != 0)
+   {
+      file = fopen(timeline, "w");
+      halSimTimeline(file);
+   }
+
+   halSimReset();
+   halSimSetVector(HAL_SIM_VECTOR_TIMER_CH1, noteTick);
+   halSimSciInject((uint64_t)UPLOAD_AT_MS * CYCLES_PER_MS, frame, (size_t)length + 4);
+   keyCycle = halSimSciInject((uint64_t)KEYS_AT_MS * CYCLES_PER_MS, "c", 1);
+   halSimStopWhen(servoDone);
+   if(halSimRun(firmwareMain, (uint64_t)(KEYS_AT_MS + CHECK_LIMIT_S * 1000UL) * CYCLES_PER_MS)
+      == 2 && servos[0].recipeEnd != 0)
+   {
+      run->finished = 1;
+      run->ms = (double)(endCycle - keyCycle) / CYCLES_PER_MS;
+      run->sinceTickMs = (double)(keyCycle - tickCycle) / CYCLES_PER_MS;
+   }
+
+   if(file != 0)
+   {
+      fclose(file);
+   }
+   _exit(0);
+}
+
+// Writes the firmware's common recipe to a file, as the board has it
+// after reset.  Returns 0 if it cannot.
+static int writeCommon(const char* path)
+{
+   pid_t child;
+   int status;
+
+   child = fork();
+   if(child == 0)
+   {
+      halSimReset();
+      (void)halSimRun(firmwareMain, (uint64_t)UPLOAD_AT_MS * CYCLES_PER_MS);
+      _exit(writeFile(path, bufferCommon, RECIPE_SIZE) ? 0 : 1);
+   }
+
+   return (child > 0 && waitpid(child, &status, 0) == child &&
+           WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 1 : 0;
+}
+
+//*****************************************************************************
+// Runs recipecheck on a recipe and picks out the time it gives.
+//
+// Parameters:  command        The recipecheck command line, the recipe
+//                             and everything else on it.
+//              ms             Set to the time in milliseconds.
+//
+// Return: 1 if recipecheck took the recipe and gave its time, otherwise 0.
+//*****************************************************************************
+static int recipecheckTime(const char* command, unsigned long* ms)
+{
+   char line[512];
+   unsigned long seconds;
+   unsigned long thousandths;
+   int found = 0;
+   const char* at;
+   FILE* output = popen(command, "r");
+
+   if(output == 0)
+   {
+      return 0;
+   }
+   while(fgets(line, sizeof(line), output) != 0)
+   {
+      at = strstr(line, ": ");
+      if(found == 0 && at != 0 &&
+         sscanf(at, ": %*u commands run in %lu.%lu s", &seconds, &thousandths) == 2)
+      {
+         *ms = seconds * 1000 + thousandths;
+         found = 1;
+      }
+   }
+
+   return (pclose(output) == 0 && found) ? 1 : 0;
+}
+
+//*****************************************************************************
+// Runs a random recipe on the simulated board and checks that it takes
+// the time recipecheck gives for it.
+//
+// Parameters:  name           What to call it.
+//              directory      Where the files go, the common recipe in it.
+//              recipecheck    The recipecheck to run.
+//              run            Shared with the process that runs the recipe.
+//
+// Return: None, a case that fails is printed and counted and its recipe
+//         left in directory.
+//*****************************************************************************
+static void runTimingCase(const char* name, const char* directory, const char* recipecheck,
+                          struct SimRun* run)
+{
+   char path[256];
+   char command[1024];
+   char expected[64];
+   char got[64];
+   UINT8 recipe[RECIPE_SIZE];
+   int length = randomRecipe(recipe, 1);
+   unsigned long ms = 0;
+
+   snprintf(path, sizeof(path), "%s/%s.bin", directory, name);
+   snprintf(command, sizeof(command), "'%s' -c '%s/common.bin' '%s'", recipecheck, directory,
+            path);
+   if(writeFile(path, recipe, length) == 0 || recipecheckTime(command, &ms) == 0)
+   {
+      fail(name, "recipecheck", "a time", "none");
+      return;
+   }
+
+   simulate(recipe, length, 0, run);
+   snprintf(expected, sizeof(expected), "%lu.%03lu s", ms / 1000, ms % 1000);
+   snprintf(got, sizeof(got), "%.3f s", run->ms / 1000);
+   if(run->finished == 0)
+   {
+      fail(name, "run", "its RECIPE_END", "none");
+      return;
+   }
+   if((run->ms < ms - CHECK_SLACK_MS || run->ms > ms + CHECK_SLACK_MS) &&
+      (run->ms < ms - run->sinceTickMs - CHECK_SLACK_MS ||
+       run->ms > ms - run->sinceTickMs + CHECK_SLACK_MS))
+   {
+      fail(name, "time", expected, got);
+      return;
+   }
+   remove(path);
+}
+
+// Tells if two times on a board the key came to sinceTickMs after a
+// tick are the same, one maybe waiting for a tick the other did not.
+static int sameTime(double ms, double other, double sinceTickMs)
+{
+   return (other >= ms - CHECK_SLACK_MS && other <= ms + CHECK_SLACK_MS) ||
+          (other >= ms - sinceTickMs - CHECK_SLACK_MS &&
+           other <= ms - sinceTickMs + CHECK_SLACK_MS) ||
+          (other >= ms + sinceTickMs - CHECK_SLACK_MS &&
+           other <= ms + sinceTickMs + CHECK_SLACK_MS);
+}
+
+//-----------------------------------------------------------------------------
+// Reads the next line of a timeline from the key on.  Returns 0 at the
+// end of the file.
+static int timelineLine(FILE* file, double* ms, char* change)
+{
+   char line[TIMELINE_LINE];
+
+   while(fgets(line, sizeof(line), file) != 0)
+   {
+      if(sscanf(line, "%lf ms %[^\n]", ms, change) == 2 && *ms >= KEYS_AT_MS)
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+//*****************************************************************************
+// Compares two timelines simulate wrote from the key on.
+//
+// Parameters:  before         The timeline of a recipe.
+//              after          That of its optimized one.
+//              sinceTickMs    From the last tick before the key to the key.
+//              difference     Set to the first change that differs.
+//
+// Return: 1 if they make the same changes at the same times.
+//*****************************************************************************
+static int sameTimeline(const char* before, const char* after, double sinceTickMs,
+                        char* difference)
+{
+   FILE* files[2];
+   char changes[2][TIMELINE_LINE];
+   double ms[2];
+   int more[2];
+   int same = 1;
+
+   files[0] = fopen(before, "r");
+   files[1] = fopen(after, "r");
+   if(files[0] == 0 || files[1] == 0)
+   {
+      strcpy(difference, "no timeline");
+      same = 0;
+   }
+
+   while(same)
+   {
+      more[0] = timelineLine(files[0], &ms[0], changes[0]);
+      more[1] = timelineLine(files[1], &ms[1], changes[1]);
+      if(more[0] == 0 && more[1] == 0)
+      {
+         break;
+      }
+      if(more[0] != more[1] || strcmp(changes[0], changes[1]) != 0 ||
+         sameTime(ms[0], ms[1], sinceTickMs) == 0)
+      {
+         sprintf(difference, "%.3f ms %s", more[1] ? ms[1] : 0.0,
+                 more[1] ? changes[1] : "nothing");
+         same = 0;
+      }
+   }
+
+   if(files[0] != 0)
+   {
+      fclose(files[0]);
+   }
+   if(files[1] != 0)
+   {
+      fclose(files[1]);
+   }
+   return same;
+}
+
+//*****************************************************************************
+// Optimizes a random recipe with recipecheck -O, runs both on the
+// simulated board and checks that they move the servo the same.
+//
+// Parameters:  name           What to call it.
+//              directory      Where the files go, the common recipe in it.
+//              recipecheck    The recipecheck to run.
+//              fine           Non-zero for fine MOVs in the recipe.
+//              run            Shared with the process that runs the recipe.
+//
+// Return: 1 if the optimized recipe is shorter.  A case that fails is
+//         printed and counted and its recipes left in directory.
+//*****************************************************************************
+static int runOptimizerCase(const char* name, const char* directory, const char* recipecheck,
+                            int fine, struct SimRun* run)
+{
+   char paths[4][256];
+   char command[1024];
+   char expected[TIMELINE_LINE + 16];
+   char got[TIMELINE_LINE + 16];
+   UINT8 recipe[RECIPE_SIZE + 1];
+   UINT8 optimized[RECIPE_SIZE + 1];
+   int length = randomRecipe(recipe, fine);
+   int optimizedLength;
+   unsigned long ms;
+   double beforeMs;
+   FILE* file;
+
+   snprintf(paths[0], sizeof(paths[0]), "%s/%s.bin", directory, name);
+   snprintf(paths[1], sizeof(paths[1]), "%s/%s-O.bin", directory, name);
+   snprintf(paths[2], sizeof(paths[2]), "%s/%s.pwm", directory, name);
+   snprintf(paths[3], sizeof(paths[3]), "%s/%s-O.pwm", directory, name);
+   snprintf(command, sizeof(command), "'%s' -c '%s/common.bin' -O '%s' '%s'", recipecheck,
+            directory, paths[1], paths[0]);
+   if(writeFile(paths[0], recipe, length) == 0 || recipecheckTime(command, &ms) == 0 ||
+      (file = fopen(paths[1], "rb")) == 0)
+   {
+      fail(name, "recipecheck -O", "an optimized recipe", "none");
+      return 0;
+   }
+   optimizedLength = (int)fread(optimized, 1, sizeof(optimized), file);
+   fclose(file);
+
+   simulate(recipe, length, paths[2], run);
+   beforeMs = run->ms;
+   if(run->finished == 0)
+   {
+      fail(name, "run", "its RECIPE_END", "none");
+      return 0;
+   }
+   simulate(optimized, optimizedLength, paths[3], run);
+   if(run->finished == 0)
+   {
+      fail(name, "optimized run", "its RECIPE_END", "none");
+      return 0;
+   }
+
+   sprintf(expected, "%.3f s", beforeMs / 1000);
+   sprintf(got, "%.3f s", run->ms / 1000);
+   if(sameTimeline(paths[2], paths[3], run->sinceTickMs, got) == 0)
+   {
+      fail(name, "optimized timeline", "the same changes", got);
+      return 0;
+   }
+   if(sameTime(beforeMs, run->ms, run->sinceTickMs) == 0)
+   {
+      fail(name, "optimized time", expected, got);
+      return 0;
+   }
+
+   remove(paths[0]);
+   remove(paths[1]);
+   remove(paths[2]);
+   remove(paths[3]);
+   return optimizedLength < length;
+}
+
+int main(int argc, char* argv[])
+{
+   const char* recipecheck = "./recipecheck";
+   char directory[] = "/tmp/simcheckXXXXXX";
+   char path[sizeof(directory) + 16];
+   struct SimRun* run;
+   char name[32];
+   int recipes = CHECK_RECIPES;
+   int before;
+   int shortened;
+   size_t index;
+   int arg = 1;
+
+   if(arg + 1 < argc && strcmp(argv[arg], "-n") == 0)
+   {
+      recipes = atoi(argv[arg + 1]);
+      arg += 2;
+   }
+   if(arg < argc)
+   {
+      recipecheck = argv[arg++];
+   }
+   if(arg < argc || recipes < 0)
+   {
+      fprintf(stderr, "usage: simcheck [-n recipes] [recipecheck]\n");
+      return 1;
+   }
+
+   halSimReset();
+
+   for(index = 0; index < CALL_CASES; index++)
+   {
+      runCallCase(&callCases[index]);
+   }
+   printf("subroutines    %u cases, %d failed\n", (unsigned)CALL_CASES, failures);
+
+   run = (struct SimRun*)mmap(0, sizeof(*run), PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if(run == MAP_FAILED || mkdtemp(directory) == 0)
+   {
+      perror("simcheck");
+      return 1;
+   }
+   snprintf(path, sizeof(path), "%s/common.bin", directory);
+   if(writeCommon(path) == 0)
+   {
+      perror("simcheck");
+      return 1;
+   }
+
+   before = failures;
+   for(index = 0; index < (size_t)recipes; index++)
+   {
+      snprintf(name, sizeof(name), "random%u", (unsigned)index);
+      runTimingCase(name, directory, recipecheck, run);
+   }
+   printf("timing         %d random recipes, %d failed\n", recipes, failures - before);
+
+   before = failures;
+   shortened = 0;
+   for(index = 0; index < (size_t)recipes; index++)
+   {
+      snprintf(name, sizeof(name), "optimize%u", (unsigned)index);
+      shortened += runOptimizerCase(name, directory, recipecheck, (int)(index % 2), run);
+   }
+   printf("optimizer      %d random recipes, %d shortened, %d failed\n", recipes, shortened,
+          failures - before);
+
+   // The failed recipes are run against the common recipe.
+   if(failures == 0)
+   {
+      remove(path);
+   }
+   if(rmdir(directory) != 0)
+   {
+      printf("the recipes that failed are in %s, with the common recipe\n", directory);
+   }
+
+   return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,1014 @@
+/******************************************************************************
+ * simmain.c
+ *
+ * Description:
+ *
+ * Host driver for the Linux simulation backend.  Boots the firmware from
+ * main.c on the simulated HCS12, feeds operator keystrokes into SCI0 and
+ * runs it for a number of virtual seconds, then reports the register state,
+ * interrupt timing and how fast the simulation ran on the host.  Last it
+ * runs servo A's recipe on both servos through processCommand to measure
+ * what one recipe instruction costs, measures what one runTasks tick
+ * costs with 1 to SERVO_COUNT servos running and compares a tick of the
+ * timing wheel against the old per-servo countdown for up to
+ * VIRTUAL_CHANNELS timers.  For host models with far more servos than the
+ * board has it compares counting KERNEL_SERVOS of them down one struct
+ * per servo against one array per field, see tickKernel.  Each
+ * measurement is one function in the benchmarks table.
+ *
+ * Build on the host with:
+ *
+ *    cc -DHOST_SIM -I. -O2 -o simmain main.c sci.c recipe.c timerwheel.c \
+ *         trace.c upload.c cmdline.c baud.c sim/hal_sim.c sim/simmain.c
+ *
+ * Usage: simmain [-l] [-e] [-w file] [-p file] [-u servo file] [-b rates] [-k pairs]
+ *                [seconds] [keystrokes]
+ *
+ *    -l   run the tasks inside OC1_isr the way the firmware used to,
+ *         for comparing worst case ISR duration against dispatchTasks
+ *    -e   stop as soon as every servo has reached its RECIPE_END or an
+ *         error, seconds being only the limit, and leave out the
+ *         measurements; for running recipes through as a regression
+ *         test, together with -p
+ *    -w   write every byte SCI0 sends to file, text and trace records,
+ *         for sim/tracedump to decode
+ *    -p   write every change of PWME, the PWM duty registers and PORTA
+ *         to file, with the virtual time it was made
+ *    -u   upload the recipe in file, raw command bytes, to servo A-H
+ *         as an upload frame (see upload.h) UPLOAD_AT_MS after reset,
+ *         while the servos are still paused unless UPLOAD_AT_MS is
+ *         built later than the keystrokes
+ *    -b   BAUD_AT_MS after reset ask for each of the comma separated baud
+ *         rates in turn, the way a host looking for the fastest one that
+ *         works would (see baud.h), and carry on at the first one the
+ *         firmware takes
+ *    -k   instead of the keystrokes type pairs of keys, an l or r for
+ *         servo A and an x, which is no command, for servo B, and print
+ *         a histogram of the time from each of servo A's keys being
+ *         received to the PWM duty of servo A changing
+ *
+ * The keystrokes are typed one every KEY_INTERVAL_MS, starting half a
+ * second after reset.  A command line among them, from its LINE_START
+ * up to its CR or LF (see cmdline.h), is typed in one go, as a script
+ * would send it.
+ *
+ * Time on the simulated board is the virtual bus clock of hal_sim.c, so
+ * a run takes only as long as the host needs for the instructions the
+ * firmware executes and skips the idle time in between; a recipe that
+ * moves for minutes runs through in milliseconds, and the same input
+ * always gives the same output.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 199309L
+#define HAL_SIM_BACKEND
+
+// system includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// project includes
+#include "types.h"
+#include "hal.h"
+#include "sci.h"
+#include "recipe.h"
+#include "timerwheel.h"
+#include "trace.h"
+#include "upload.h"
+#include "cmdline.h"
+#include "baud.h"
+
+#ifndef UPLOAD_AT_MS
+#define UPLOAD_AT_MS     100
+#endif
+
+#ifndef KEY_INTERVAL_MS
+#define KEY_INTERVAL_MS  250
+#endif
+
+// After the upload frame and before the keystrokes.
+#ifndef BAUD_AT_MS
+#define BAUD_AT_MS       200
+#endif
+
+// Most rates -b tries.
+#define BAUD_RATES_MAX   8
+
+// Most pairs -k types.  Each pair takes two KEY_INTERVAL_MS and up to
+// a tick more, so the key comes in at every point between two ticks.
+#define LATENCY_KEYS_MAX 10000
+#define LATENCY_JITTER_MS 50
+
+// Upper ends, in microseconds, of the latency histogram buckets; the
+// last bucket takes everything longer.
+static const unsigned long latencyBuckets[] =
+{
+   100, 1000, 10000, 50000, 100000, 250000, 500000
+};
+#define LATENCY_BUCKETS  (sizeof(latencyBuckets) / sizeof(latencyBuckets[0]) + 1)
+
+// Passes over the recipe for the processCommand measurement.
+#define BENCH_PASSES     20000
+
+// Passes, and ticks in each pass, for the runTasks measurement.
+#define TICK_PASSES      2000
+#define TICKS_PER_PASS   500
+
+// Timers, and ticks to run them for, for the timing wheel measurement.
+#define VIRTUAL_CHANNELS 800
+#define WHEEL_BENCH_TICKS 200000
+
+// Most virtual servos, and servo ticks for each count of them, for the
+// countdown layout measurement.
+#define KERNEL_SERVOS    16384
+#define KERNEL_BENCH_WORK 50000000L
+
+// OC1_isr ticks every 50 ms.
+#define TICK_MS          50
+
+extern void firmwareMain(void);
+extern void OC1_isr(void);
+extern void dispatchTasks(void);
+extern void runTasks(void);
+extern UINT8 servoCount;
+extern struct TaskControlBlock servos[SERVO_COUNT];
+extern struct Instruction programServo[SERVO_COUNT][2][RECIPE_SIZE];
+
+// Moves between the end stops for 32 loops, more than TICKS_PER_PASS
+// ticks' worth.
+static const UINT8 tickRecipe[] =
+{
+   LOOP_START + 31, MOV + 0, WAIT + 1, MOV + 5, END_LOOP, RECIPE_END
+};
+
+// OC1_isr as it was before the tasks moved out to the main loop.
+static void legacyOC1_isr(void)
+{
+   OC1_isr();
+   dispatchTasks();
+}
+
+// A WAIT of 1 to 31 units in ms, from a fixed pseudo random sequence.
+static UINT16 benchWait(UINT32* seed)
+{
+   *seed = *seed * 1103515245UL + 12345UL;
+   return (UINT16)((1 + (*seed >> 16) % 31) * 100);
+}
+
+// A virtual servo counted down the way updateTaskStatus used to, before
+// the deadlines and the timing wheel, one struct per servo.
+struct BenchServo
+{
+   enum TASKSTATUS status;
+   INT16 timeLeftms;
+   UINT8 currentServoPosition;
+   UINT8 expectedServoPosition;
+};
+
+static struct BenchServo benchServos[KERNEL_SERVOS];
+
+// The same servos one array per field.
+static struct
+{
+   UINT8 status[KERNEL_SERVOS];
+   INT16 timeLeftms[KERNEL_SERVOS];
+   UINT8 currentServoPosition[KERNEL_SERVOS];
+   UINT8 expectedServoPosition[KERNEL_SERVOS];
+} benchFields;
+
+// Starts a finished virtual servo on its next move, somewhere else.
+static void benchMove(UINT8* status, INT16* timeLeftms, UINT8 current, UINT8* expected,
+                      UINT32* seed)
+{
+   *timeLeftms = (INT16)benchWait(seed);
+   *expected = (UINT8)((current + 1 + (*seed >> 8) % 5) % 6);
+   *status = running;
+}
+
+// One tick for struct per servo virtual servos: count each running one
+// down, and start each one that has finished on its next move.  Returns
+// how many finished.
+static unsigned long tickServos(int count, UINT32* seed)
+{
+   struct BenchServo* servo;
+   unsigned long finished = 0;
+   UINT8 status;
+
+   for(servo = benchServos; servo < &benchServos[count]; servo++)
+   {
+      if(servo->status == running)
+      {
+         servo->timeLeftms -= TICK_MS;
+         if(servo->timeLeftms <= 0)
+         {
+            servo->status = ready;
+            servo->currentServoPosition = servo->expectedServoPosition;
+         }
+      }
+      if(servo->status == ready)
+      {
+         benchMove(&status, &servo->timeLeftms, servo->currentServoPosition,
+                   &servo->expectedServoPosition, seed);
+         servo->status = (enum TASKSTATUS)status;
+         finished++;
+      }
+   }
+
+   return finished;
+}
+
+//*****************************************************************************
+// One tick for array per field virtual servos, the same as tickServos.
+// Counting down is done for every servo with no branches, each field a
+// straight pass over its array, which the compiler can turn into SIMD
+// instructions (gcc and clang do at -O3) working on 16 or 32 servos at a
+// time.  Only the servos that finished then need a look of their own.
+//
+// Parameters:  count          Servos, benchFields.x[0] to x[count - 1].
+//              seed           For the moves the finished servos start.
+//
+// Return: How many servos finished.
+//*****************************************************************************
+static unsigned long tickKernel(int count, UINT32* seed)
+{
+   unsigned long finished = 0;
+   int index;
+   INT16 left;
+   UINT8 done;
+   UINT8* status;
+   UINT8* end;
+
+   for(index = 0; index < count; index++)
+   {
+      left = (INT16)(benchFields.timeLeftms[index] -
+                     (benchFields.status[index] == running ? TICK_MS : 0));
+      done = (UINT8)(benchFields.status[index] == running && left <= 0);
+      benchFields.timeLeftms[index] = left;
+      benchFields.status[index] = done ? (UINT8)ready : benchFields.status[index];
+      benchFields.currentServoPosition[index] = done ?
+         benchFields.expectedServoPosition[index] : benchFields.currentServoPosition[index];
+   }
+
+   // Few finish on any one tick; memchr skips over the rest many at a time.
+   end = &benchFields.status[count];
+   for(status = memchr(benchFields.status, ready, (size_t)count); status != 0;
+       status = memchr(status + 1, ready, (size_t)(end - status - 1)))
+   {
+      index = (int)(status - benchFields.status);
+      benchMove(status, &benchFields.timeLeftms[index], benchFields.currentServoPosition[index],
+                &benchFields.expectedServoPosition[index], seed);
+      finished++;
+   }
+
+   return finished;
+}
+
+static double hostSeconds(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// When each of servo A's -k keys was received, and what became of them.
+static uint64_t keyReceived[LATENCY_KEYS_MAX];
+static int keysTyped = 0;
+static int keysAnswered = 0;
+static unsigned long latencyCounts[LATENCY_BUCKETS];
+static uint64_t latencyTotal = 0;
+static uint64_t latencyMax = 0;
+
+// Puts the time since the oldest key servo A has not answered yet into
+// the histogram when servo A's duty changes.
+static void keyLatency(UINT8 channel, UINT16 duty)
+{
+   uint64_t latency;
+   unsigned long us;
+   size_t bucket;
+
+   (void)duty;
+   if(channel != servos[0].channel->pwmChannel || keysAnswered == keysTyped || keyReceived[keysAnswered] > halSimCycles())
+   {
+      return;
+   }
+
+   latency = halSimCycles() - keyReceived[keysAnswered++];
+   latencyTotal += latency;
+   if(latency > latencyMax)
+   {
+      latencyMax = latency;
+   }
+   us = (unsigned long)(latency * 1000000 / HAL_SIM_BUS_CLK_FREQ);
+   for(bucket = 0; bucket < LATENCY_BUCKETS - 1 && us >= latencyBuckets[bucket]; bucket++)
+   {
+   }
+   latencyCounts[bucket]++;
+}
+
+// Types pairs of keys for the latency histogram, starting at ms.  The
+// first l takes servo A from its unknown position to 0 and the second to
+// 1, then r and l take turns, so every one of servo A's keys moves it.
+static void typeLatencyKeys(int pairs, unsigned long ms)
+{
+   UINT32 seed = 1;
+   const char* key;
+
+   for(keysTyped = 0; keysTyped < pairs && keysTyped < LATENCY_KEYS_MAX; keysTyped++)
+   {
+      key = (keysTyped == 0 || keysTyped % 2 == 1) ? "l" : "r";
+      keyReceived[keysTyped] = halSimSciInject(ms * (HAL_SIM_BUS_CLK_FREQ / 1000), key, 1);
+      halSimSciInject((ms + KEY_INTERVAL_MS) * (HAL_SIM_BUS_CLK_FREQ / 1000), "x", 1);
+
+      seed = seed * 1103515245UL + 12345UL;
+      ms += 2 * KEY_INTERVAL_MS + (seed >> 16) % LATENCY_JITTER_MS;
+   }
+   halSimDutyHook(keyLatency);
+}
+
+// Where -b's side of the baud rate negotiation is.
+enum HOSTBAUD
+{
+  HOST_IDLE = 0,                // not asked, or finished
+  HOST_ASKED,                   // waiting for the answer to a request
+  HOST_CONFIRMING               // switched, waiting for the answer to the ACK
+};
+
+static enum HOSTBAUD hostBaud = HOST_IDLE;
+static UINT32 baudRates[BAUD_RATES_MAX];
+static int baudRateCount = 0;
+static int baudTried = 0;
+static UINT32 baudOld = SCI_BAUD;
+static UINT32 baudTaken = 0;
+static uint64_t baudTakenCycle = 0;
+static uint64_t baudAskedCycle = 0;
+static int recordLeft = 0;
+
+// Sends the request for the next rate to try, ms from now.
+static void askBaud(uint64_t ms)
+{
+   char request[4];
+   UINT16 hundreds;
+
+   if(baudTried == baudRateCount)
+   {
+      hostBaud = HOST_IDLE;
+      return;
+   }
+
+   hundreds = (UINT16)(baudRates[baudTried] / 100);
+   request[0] = BAUD_START;
+   request[1] = (char)(hundreds >> 8);
+   request[2] = (char)(hundreds & 0xFF);
+   request[3] = (char)(UINT8)-(UINT8)(request[1] + request[2]);
+   baudAskedCycle = halSimSciInject(halSimCycles() + ms * (HAL_SIM_BUS_CLK_FREQ / 1000),
+                                    request, sizeof(request));
+   hostBaud = HOST_ASKED;
+}
+
+// The host's side of the negotiation: picks the answers out of what the
+// firmware sends, leaving out the trace records, and switches its own
+// rate the way baud.h says.
+static void hostReceived(UINT8 ch)
+{
+   static const char confirm[] = { UPLOAD_ACK };
+
+   if(recordLeft > 0)
+   {
+      recordLeft--;
+      return;
+   }
+   if(ch & TRACE_SYNC)
+   {
+      recordLeft = TRACE_RECORD_SIZE - 1;
+      return;
+   }
+   if(hostBaud == HOST_IDLE || halSimCycles() < baudAskedCycle ||
+      (hostBaud == HOST_ASKED && ch != UPLOAD_ACK && ch != UPLOAD_NAK))
+   {
+      return;
+   }
+
+   if(hostBaud == HOST_ASKED && ch == UPLOAD_ACK)
+   {
+      halSimSciHostBaud(baudRates[baudTried]);
+      baudAskedCycle = halSimSciInject(halSimCycles() + (uint64_t)BAUD_SETTLE_TICKS * TICK_MS *
+                                       (HAL_SIM_BUS_CLK_FREQ / 1000), confirm, 1);
+      hostBaud = HOST_CONFIRMING;
+   }
+   else if(hostBaud == HOST_CONFIRMING && ch == UPLOAD_ACK)
+   {
+      baudTaken = baudRates[baudTried];
+      baudOld = baudTaken;
+      baudTakenCycle = halSimCycles();
+      hostBaud = HOST_IDLE;
+   }
+   else if(hostBaud == HOST_CONFIRMING)
+   {
+      // Garbled, the firmware is going back.  Give it time to.
+      halSimSciHostBaud(baudOld);
+      baudTried++;
+      askBaud((uint64_t)(BAUD_CONFIRM_TICKS + 2) * TICK_MS);
+   }
+   else
+   {
+      baudTried++;
+      askBaud(1);
+   }
+}
+
+// Tells the simulator the run is over once every servo has finished its
+// recipe, the way the LEDs show it.  A servo that has no recipe, one that
+// is only its RECIPE_END, never runs and is left out.
+static int recipesDone(void)
+{
+   UINT8 index;
+
+   for(index = 0; index < servoCount; index++)
+   {
+      if(servos[index].program[0].command != RECIPE_END &&
+         servos[index].recipeEnd == 0 && servos[index].status != error)
+      {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+// Runs a recipe on a servo straight through to its RECIPE_END, ignoring
+// the time each command takes.  Returns the number of instructions run.
+static unsigned long runRecipe(struct TaskControlBlock* servo, struct Instruction* program)
+{
+   unsigned long count = 0;
+
+   servo->currentCommand = program;
+   servo->recipeEnd = 0;
+   servo->loopDepth = 0;
+   servo->callDepth = 0;
+   servo->status = ready;
+
+   while(servo->recipeEnd == 0 && servo->status != error && count < 1000)
+   {
+      processCommand(servo, servo->currentCommand->command, servo->currentCommand->context);
+      count++;
+   }
+   return count;
+}
+
+// Reads a recipe from a file and types it into SCI0 as an upload frame.
+// Returns 0 if the file cannot be used.
+static int injectUpload(char servo, const char* path)
+{
+   char frame[RECIPE_SIZE + 4];
+   FILE* file = fopen(path, "rb");
+   size_t length;
+   size_t index;
+   UINT8 sum;
+
+   if(file == 0)
+   {
+      perror(path);
+      return 0;
+   }
+   length = fread(&frame[3], 1, RECIPE_SIZE + 1, file);
+   fclose(file);
+   if(length == 0 || length > RECIPE_SIZE || servo < 'A' || servo > 'H')
+   {
+      fprintf(stderr, "%s: need 1 to %d command bytes for servo A to H\n", path, RECIPE_SIZE);
+      return 0;
+   }
+
+   frame[0] = UPLOAD_START;
+   frame[1] = (char)(servo - 'A');
+   frame[2] = (char)length;
+   sum = 0;
+   for(index = 1; index < length + 3; index++)
+   {
+      sum = (UINT8)(sum + (UINT8)frame[index]);
+   }
+   frame[length + 3] = (char)(UINT8)-sum;
+
+   halSimSciInject((uint64_t)UPLOAD_AT_MS * (HAL_SIM_BUS_CLK_FREQ / 1000), frame, length + 4);
+   return 1;
+}
+
+// Times one 48 byte message as the firmware sees it, through printf and
+// through the Put functions that replaced it.  The simulator does not
+// charge for formatting, so the host time, with the transmit buffer full
+// and every character dropped, is what shows the cost of parsing the
+// format.
+static void benchPrintf(void)
+{
+   double cycles;
+   double putCycles;
+   double printfHost;
+   double start;
+   long pass;
+
+   start = (double)halSimCycles();
+   (void)halSimPrintf("\r\nprocessCommand: undefined command for servo%c\r\n", 'A');
+   cycles = (double)halSimCycles() - start;
+
+   start = (double)halSimCycles();
+   PutString("\r\nprocessCommand: undefined command for servo");
+   TERMIO_PutChar('A');
+   PutString("\r\n");
+   putCycles = (double)halSimCycles() - start;
+
+   halDisableInterrupts();
+   start = hostSeconds();
+   for(pass = 0; pass < BENCH_PASSES; pass++)
+   {
+      (void)halSimPrintf("\r\nprocessCommand: undefined command for servo%c\r\n", 'A');
+   }
+   printfHost = hostSeconds() - start;
+
+   start = hostSeconds();
+   for(pass = 0; pass < BENCH_PASSES; pass++)
+   {
+      PutString("\r\nprocessCommand: undefined command for servo");
+      TERMIO_PutChar('A');
+      PutString("\r\n");
+   }
+   halEnableInterrupts();
+
+   printf("printf         %.1f us, %.0f ns on the host for a 48 byte message\n",
+          cycles * 1e6 / HAL_SIM_BUS_CLK_FREQ, printfHost * 1e9 / BENCH_PASSES);
+   printf("PutString      %.1f us, %.0f ns on the host for the same message\n",
+          putCycles * 1e6 / HAL_SIM_BUS_CLK_FREQ,
+          (hostSeconds() - start) * 1e9 / BENCH_PASSES);
+}
+
+// Against that, what one trace record costs the task that writes it.
+// Streaming is off so the ring keeps turning over instead of filling.
+static void benchTrace(void)
+{
+   uint64_t cycles;
+   double start;
+   double elapsed;
+   long pass;
+
+   traceStreaming = FALSE;
+   cycles = halSimCycles();
+   traceEvent(TRACE_COMMAND, 0, MOV + 3);
+   cycles = halSimCycles() - cycles;
+
+   start = hostSeconds();
+   for(pass = 0; pass < BENCH_PASSES; pass++)
+   {
+      traceEvent(TRACE_COMMAND, (UINT8)(pass & 7), (UINT8)pass);
+   }
+   elapsed = hostSeconds() - start;
+   traceStreaming = TRUE;
+
+   printf("traceEvent     %.1f us, %.0f ns on the host for a 4 byte record\n",
+          cycles * 1e6 / HAL_SIM_BUS_CLK_FREQ, elapsed * 1e9 / BENCH_PASSES);
+}
+
+// Cost of one recipe instruction, in simulated cycles (register accesses
+// only) and in host time.  Both servos run the same recipe so neither
+// gets the cheaper side of a servo comparison.
+static void benchCommand(void)
+{
+   unsigned long instructions = 0;
+   uint64_t cycles = halSimCycles();
+   double start;
+   double elapsed;
+   long pass;
+
+   halDisableInterrupts();
+   start = hostSeconds();
+   for(pass = 0; pass < BENCH_PASSES; pass++)
+   {
+      instructions += runRecipe(&servos[0], programServo[0][0]);
+      instructions += runRecipe(&servos[1], programServo[0][0]);
+   }
+   elapsed = hostSeconds() - start;
+   printf("processCommand %.1f cycles, %.1f ns on the host per instruction\n",
+          (double)(halSimCycles() - cycles) / instructions,
+          elapsed * 1e9 / instructions);
+}
+
+// Cost of one runTasks tick as the number of running servos grows.
+static void benchTasks(void)
+{
+   double start;
+   double elapsed;
+   UINT8 count;
+   UINT8 index;
+   long pass;
+   int tick;
+
+   for(count = 1; count <= SERVO_COUNT; count *= 2)
+   {
+      uint64_t cycles = 0;
+
+      servoCount = count;
+      elapsed = 0;
+      for(pass = 0; pass < TICK_PASSES; pass++)
+      {
+         for(index = 0; index < count; index++)
+         {
+            (void)loadRecipe(&servos[index], tickRecipe, programServo[index][0]);
+            servos[index].recipeEnd = 0;
+            servos[index].loopDepth = 0;
+            servos[index].callDepth = 0;
+            servos[index].currentServoPosition = 255;
+            servos[index].status = ready;
+         }
+
+         cycles -= halSimCycles();
+         start = hostSeconds();
+         for(tick = 0; tick < TICKS_PER_PASS; tick++)
+         {
+            runTasks();
+         }
+         elapsed += hostSeconds() - start;
+         cycles += halSimCycles();
+      }
+      printf("runTasks       %u servos, %.1f cycles, %.1f ns on the host per tick\n",
+             count, (double)cycles / (TICK_PASSES * TICKS_PER_PASS),
+             elapsed * 1e9 / (TICK_PASSES * TICKS_PER_PASS));
+   }
+}
+
+// Timers for hundreds of virtual channels, each restarted with a new WAIT
+// as soon as it expires.  Once counted down on every tick the way
+// updateTaskStatus used to, once on a timing wheel.
+static void benchTimers(void)
+{
+   static INT16 countdown[VIRTUAL_CHANNELS];
+   static struct WheelTimer timers[VIRTUAL_CHANNELS];
+   struct TimerWheel wheel;
+   struct WheelTimer* timer;
+   UINT32 seed;
+   unsigned long expired;
+   double countdownTime;
+   double start;
+   double elapsed;
+   int count;
+   int index;
+   long tick;
+
+   for(count = 100; count <= VIRTUAL_CHANNELS; count *= 2)
+   {
+      seed = 1;
+      expired = 0;
+      for(index = 0; index < count; index++)
+      {
+         countdown[index] = (INT16)benchWait(&seed);
+      }
+      start = hostSeconds();
+      for(tick = 0; tick < WHEEL_BENCH_TICKS; tick++)
+      {
+         for(index = 0; index < count; index++)
+         {
+            if(countdown[index] > 0)
+            {
+               countdown[index] -= 50;
+            }
+            else
+            {
+               countdown[index] = (INT16)benchWait(&seed);
+               expired++;
+            }
+         }
+      }
+      countdownTime = hostSeconds() - start;
+
+      seed = 1;
+      wheelInit(&wheel);
+      for(index = 0; index < count; index++)
+      {
+         timers[index].slot = 0;
+         wheelAdd(&wheel, &timers[index], (UINT16)(benchWait(&seed) / 50));
+      }
+      start = hostSeconds();
+      for(tick = 0; tick < WHEEL_BENCH_TICKS; tick++)
+      {
+         timer = wheelTick(&wheel);
+         while(timer != 0)
+         {
+            struct WheelTimer* next = timer->next;
+
+            wheelAdd(&wheel, timer, (UINT16)(benchWait(&seed) / 50));
+            timer = next;
+         }
+      }
+      elapsed = hostSeconds() - start;
+
+      printf("timers         %d channels, %.2f expire per tick, %.1f ns countdown, "
+             "%.1f ns wheel per tick\n",
+             count, (double)expired / WHEEL_BENCH_TICKS,
+             countdownTime * 1e9 / WHEEL_BENCH_TICKS,
+             elapsed * 1e9 / WHEEL_BENCH_TICKS);
+   }
+}
+
+// Thousands of virtual servos counted down every tick, a struct per
+// servo against an array per field.  Both start the same moves from
+// the same seed, so they must finish the same servos.
+static void benchCountdown(void)
+{
+   UINT32 structSeed;
+   UINT32 fieldSeed;
+   unsigned long structFinished;
+   unsigned long fieldFinished;
+   double structTime;
+   double start;
+   double elapsed;
+   long ticks;
+   long tick;
+   int count;
+   int index;
+
+   for(count = 256; count <= KERNEL_SERVOS; count *= 8)
+   {
+      ticks = KERNEL_BENCH_WORK / count;
+      structSeed = 1;
+      fieldSeed = 1;
+      structFinished = 0;
+      fieldFinished = 0;
+      for(index = 0; index < count; index++)
+      {
+         benchServos[index].status = ready;
+         benchServos[index].currentServoPosition = 0;
+         benchFields.status[index] = ready;
+         benchFields.currentServoPosition[index] = 0;
+      }
+
+      start = hostSeconds();
+      for(tick = 0; tick < ticks; tick++)
+      {
+         structFinished += tickServos(count, &structSeed);
+      }
+      structTime = hostSeconds() - start;
+
+      start = hostSeconds();
+      for(tick = 0; tick < ticks; tick++)
+      {
+         fieldFinished += tickKernel(count, &fieldSeed);
+      }
+      elapsed = hostSeconds() - start;
+
+      printf("countdown      %d servos, %.0f finish per tick, %.2f ns struct, "
+             "%.2f ns array per servo%s\n",
+             count, (double)structFinished / ticks, structTime * 1e9 / KERNEL_BENCH_WORK,
+             elapsed * 1e9 / KERNEL_BENCH_WORK,
+             structFinished == fieldFinished && structSeed == fieldSeed ? "" : ", DIFFER");
+   }
+}
+
+// The measurements, in the order they run after the firmware has.
+static void (* const benchmarks[])(void) =
+{
+   benchPrintf,
+   benchTrace,
+   benchCommand,
+   benchTasks,
+   benchTimers,
+   benchCountdown
+};
+
+// Runs every measurement in benchmarks.
+static void runBenchmarks(void)
+{
+   size_t index;
+
+   for(index = 0; index < sizeof(benchmarks) / sizeof(benchmarks[0]); index++)
+   {
+      benchmarks[index]();
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   double seconds = 30.0;
+   const char* keys = "cc";
+   FILE* wire = 0;
+   FILE* pwm = 0;
+   int untilDone = 0;
+   int latencyPairs = 0;
+   int stopped;
+   const char* uploadPath = 0;
+   char uploadServo = 'A';
+   char* rate;
+   const struct HalSimRegisters* regs;
+   struct HalSimIsrStats stats;
+   double start;
+   double elapsed;
+   double virtualSeconds;
+   int channel;
+   size_t key;
+   size_t slot;
+   size_t length;
+
+   int arg = 1;
+
+   halSimReset();
+
+   if(arg < argc && strcmp(argv[arg], "-l") == 0)
+   {
+      halSimSetVector(HAL_SIM_VECTOR_TIMER_CH1, legacyOC1_isr);
+      arg++;
+   }
+   if(arg < argc && strcmp(argv[arg], "-e") == 0)
+   {
+      halSimStopWhen(recipesDone);
+      untilDone = 1;
+      arg++;
+   }
+   if(arg + 1 < argc && strcmp(argv[arg], "-w") == 0)
+   {
+      wire = fopen(argv[arg + 1], "wb");
+      if(wire == 0)
+      {
+         perror(argv[arg + 1]);
+         return 1;
+      }
+      halSimSciEcho(wire);
+      arg += 2;
+   }
+   if(arg + 1 < argc && strcmp(argv[arg], "-p") == 0)
+   {
+      pwm = fopen(argv[arg + 1], "w");
+      if(pwm == 0)
+      {
+         perror(argv[arg + 1]);
+         return 1;
+      }
+      halSimTimeline(pwm);
+      arg += 2;
+   }
+   if(arg + 2 < argc && strcmp(argv[arg], "-u") == 0)
+   {
+      uploadServo = argv[arg + 1][0];
+      uploadPath = argv[arg + 2];
+      arg += 3;
+   }
+   if(arg + 1 < argc && strcmp(argv[arg], "-b") == 0)
+   {
+      for(rate = strtok(argv[arg + 1], ","); rate != 0 && baudRateCount < BAUD_RATES_MAX;
+          rate = strtok(0, ","))
+      {
+         baudRates[baudRateCount++] = (UINT32)atol(rate);
+      }
+      arg += 2;
+   }
+   if(arg + 1 < argc && strcmp(argv[arg], "-k") == 0)
+   {
+      latencyPairs = atoi(argv[arg + 1]);
+      keys = "";
+      arg += 2;
+   }
+   if(arg < argc)
+   {
+      seconds = atof(argv[arg++]);
+   }
+   if(arg < argc && latencyPairs == 0)
+   {
+      keys = argv[arg++];
+   }
+
+   // SCI0 takes the bytes in the order they are injected.  A command
+   // line goes in whole, in the time of one key.
+   for(key = 0, slot = 0; keys[key] != '\0' || uploadPath != 0; key += length, slot++)
+   {
+      if(uploadPath != 0 && (keys[key] == '\0' || UPLOAD_AT_MS <= 500 + slot * KEY_INTERVAL_MS))
+      {
+         if(injectUpload(uploadServo, uploadPath) == 0)
+         {
+            return 1;
+         }
+         uploadPath = 0;
+      }
+      if(keys[key] == '\0')
+      {
+         break;
+      }
+      length = 1;
+      if(keys[key] == LINE_START)
+      {
+         length = strcspn(&keys[key], "\r\n");
+         length += (keys[key + length] != '\0') ? 1 : 0;
+      }
+      halSimSciInject((500 + slot * KEY_INTERVAL_MS) * (HAL_SIM_BUS_CLK_FREQ / 1000),
+                      &keys[key], length);
+   }
+   if(latencyPairs > 0)
+   {
+      typeLatencyKeys(latencyPairs, 500);
+   }
+   if(baudRateCount > 0)
+   {
+      halSimSciTxHook(hostReceived);
+      askBaud(BAUD_AT_MS);
+   }
+
+   start = hostSeconds();
+   stopped = halSimRun(firmwareMain, (uint64_t)(seconds * HAL_SIM_BUS_CLK_FREQ));
+   elapsed = hostSeconds() - start;
+   if(wire != 0)
+   {
+      halSimSciEcho(0);
+      fclose(wire);
+   }
+   if(pwm != 0)
+   {
+      halSimTimeline(0);
+      fclose(pwm);
+   }
+   virtualSeconds = (double)halSimCycles() / HAL_SIM_BUS_CLK_FREQ;
+
+   regs = halSimRegisters();
+   printf("\nvirtual time   %.3f s\n", virtualSeconds);
+   printf("host time      %.3f s (%.0fx real time)\n", elapsed,
+          elapsed > 0 ? virtualSeconds / elapsed : 0.0);
+   if(untilDone)
+   {
+      printf("recipes        %s\n", stopped == 2 ? "all finished" : "still running at the limit");
+   }
+   printf("PWME           0x%02X\n", regs->PWME);
+#ifndef PWM_16BIT
+   for(channel = 0; channel < 2; channel++)
+   {
+      printf("PWMDTY%d        0x%02X\n", channel, regs->PWMDTY[channel]);
+   }
+#else
+   for(channel = 1; channel < 4; channel += 2)
+   {
+      printf("PWMDTY%d%d       0x%02X%02X\n", channel - 1, channel,
+             regs->PWMDTY[channel - 1], regs->PWMDTY[channel]);
+   }
+#endif
+   printf("PORTA          0x%02X\n", regs->PORTA);
+   printf("SCI0 tx bytes  %lu on the wire, %lu queued, %lu dropped\n",
+          (unsigned long)halSimSciOutputLength(), (unsigned long)txBytesQueued,
+          (unsigned long)txBytesDropped);
+   printf("SCI0 rx        %u dropped, %u overruns\n", rxBytesDropped, rxOverruns);
+   if(baudRateCount > 0)
+   {
+      if(baudTaken != 0)
+      {
+         printf("SCI0 baud      %lu from %.3f s, %d refused first\n", (unsigned long)baudTaken,
+                (double)baudTakenCycle / HAL_SIM_BUS_CLK_FREQ, baudTried);
+      }
+      else
+      {
+         printf("SCI0 baud      %lu, every rate asked for refused\n", (unsigned long)baudOld);
+      }
+      printf("SCI0 framing   %lu bytes garbled\n", halSimSciFramingErrors());
+   }
+
+   if(keysTyped > 0)
+   {
+      size_t bucket;
+
+      printf("key latency    %d keys, %d moved servo A, mean %.3f ms, max %.3f ms\n",
+             keysTyped, keysAnswered,
+             keysAnswered ? latencyTotal * 1e3 / HAL_SIM_BUS_CLK_FREQ / keysAnswered : 0.0,
+             latencyMax * 1e3 / HAL_SIM_BUS_CLK_FREQ);
+      for(bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+      {
+         printf("    %s %6.1f ms  %lu\n", bucket < LATENCY_BUCKETS - 1 ? "< " : ">=",
+                latencyBuckets[bucket < LATENCY_BUCKETS - 1 ? bucket : bucket - 1] / 1000.0,
+                latencyCounts[bucket]);
+      }
+   }
+
+   halSimIsrStats(HAL_SIM_VECTOR_TIMER_CH1, &stats);
+   printf("OC1_isr        %lu calls, max %llu cycles (%.1f us), mean %.1f cycles\n",
+          (unsigned long)stats.count, (unsigned long long)stats.maxCycles,
+          stats.maxCycles * 1e6 / HAL_SIM_BUS_CLK_FREQ,
+          stats.count ? (double)stats.totalCycles / stats.count : 0.0);
+
+   {
+      struct HalSimIsrStats total = {0, 0, 0};
+
+      for(channel = 0; channel < 6; channel++)
+      {
+         halSimIsrStats(HAL_SIM_VECTOR_TIMER_CH2 + channel, &stats);
+         total.count += stats.count;
+         total.totalCycles += stats.totalCycles;
+         if(stats.maxCycles > total.maxCycles)
+         {
+            total.maxCycles = stats.maxCycles;
+         }
+      }
+      printf("TC2..7_isr     %lu calls, max %llu cycles (%.1f us), mean %.1f cycles\n",
+             (unsigned long)total.count, (unsigned long long)total.maxCycles,
+             total.maxCycles * 1e6 / HAL_SIM_BUS_CLK_FREQ,
+             total.count ? (double)total.totalCycles / total.count : 0.0);
+   }
+
+   if(untilDone)
+   {
+      return stopped == 2 ? 0 : 1;
+   }
+
+   runBenchmarks();
+
+   return 0;
+}
@@ -0,0 +1,212 @@
+/******************************************************************************
+ * tracedump.c
+ *
+ * Description:
+ *
+ * Host decoder for the binary trace the firmware streams on SCI0, see
+ * trace.h.  Reads what the serial line carried, passes the terminal text
+ * through as it is and prints each trace record, and each answer to a
+ * recipe upload, command line or baud rate request (see upload.h,
+ * cmdline.h and baud.h), on a line of its own:
+ *
+ *    #    412.350 ms  B  MOV 5
+ *    #    412.350 ms     ACK
+ *
+ * Positions reached are printed the way a MOV names them, with the fine
+ * steps of a fine MOV (see recipe.h) as hundredths: 2.34 is a fine MOV
+ * to 117.
+ *
+ * The time is in milliseconds from the first record.  TCNT runs at
+ * TIMER_CLK_FREQ (clock.h), 750 kHz, and wraps every 87.381 ms, so each
+ * record is taken to be less than a wrap after the one before it; the
+ * TRACE_TICK records keep the gaps short enough unless records were
+ * lost.
+ *
+ * Build on the host with:
+ *
+ *    cc -I. -O2 -o tracedump sim/tracedump.c
+ *
+ * with the same clock.h settings, PLL_OFF or not, as the firmware.
+ *
+ * Usage: tracedump [-q] [file]
+ *
+ *    -q   records only, leave the terminal text out
+ *
+ * Reads standard input when no file is given, so it can sit on the
+ * serial port, or read what simmain -w wrote.
+ *
+ *****************************************************************************/
+
+// The host widths for the firmware's integer types.
+#ifndef HOST_SIM
+#define HOST_SIM
+#endif
+
+// system includes
+#include <stdio.h>
+#include <string.h>
+
+// project includes
+#include "types.h"
+#include "clock.h"
+#include "recipe.h"
+#include "trace.h"
+#include "upload.h"
+
+// TCNT counts per millisecond.
+#define COUNTS_PER_MS  ((double)TIMER_COUNTS_PER_MS)
+
+static int quiet = 0;
+static int atLineStart = 1;
+static int haveTime = 0;
+static unsigned long long now = 0;   // counts since the first record
+static UINT16 lastTime = 0;
+
+// Prints what a command byte asks for.
+static void printCommand(UINT8 command)
+{
+   switch(firstThree(command))
+   {
+      case RECIPE_END: printf("RECIPE_END"); break;
+      case MOV:        printf(lastFive(command) == FINE_MOV ? "MOV fine" : "MOV %u",
+                              lastFive(command)); break;
+      case WAIT:       printf("WAIT %u", lastFive(command)); break;
+      case BREAK_LOOP: printf("BREAK_LOOP"); break;
+      case LOOP_START: printf("LOOP_START %u", lastFive(command)); break;
+      case END_LOOP:   printf("END_LOOP"); break;
+      case CALL:       printf("CALL %u", lastFive(command)); break;
+      default:         printf("RET"); break;
+   }
+}
+
+// Prints a position in fine steps as the position 0-5 it is at or past,
+// and how far on it is to the next, 2.34 for 117.
+static void printPosition(UINT8 position)
+{
+   if(position > MAX_FINE_POSITION || position % FINE_STEPS_PER_POSITION == 0)
+   {
+      printf("%u", position > MAX_FINE_POSITION ? position :
+                   position / FINE_STEPS_PER_POSITION);
+   }
+   else
+   {
+      printf("%u.%02u", position / FINE_STEPS_PER_POSITION,
+             position % FINE_STEPS_PER_POSITION * 100 / FINE_STEPS_PER_POSITION);
+   }
+}
+
+// Prints one record on a line of its own.
+static void printRecord(const UINT8* bytes)
+{
+   UINT8 event = (UINT8)((bytes[0] >> 3) & 0x0F);
+   UINT8 servo = (UINT8)(bytes[0] & 0x07);
+   UINT16 time = (UINT16)((bytes[2] << 8) | bytes[3]);
+
+   if(haveTime)
+   {
+      now += (UINT16)(time - lastTime);
+   }
+   haveTime = 1;
+   lastTime = time;
+
+   if(!atLineStart)
+   {
+      putchar('\n');
+   }
+   printf("# %10.3f ms  ", now / COUNTS_PER_MS);
+
+   switch(event)
+   {
+      case TRACE_TICK:
+         printf("   tick %u", bytes[1]);
+         break;
+
+      case TRACE_COMMAND:
+         printf("%c  ", 'A' + servo);
+         printCommand(bytes[1]);
+         break;
+
+      case TRACE_READY:
+         printf("%c  ready at position ", 'A' + servo);
+         printPosition(bytes[1]);
+         break;
+
+      case TRACE_SWITCH:
+         printf("%c  switched to the staged recipe", 'A' + servo);
+         break;
+
+      case TRACE_LOST:
+         printf("   %u%s records lost", bytes[1], bytes[1] == 0xFF ? " or more" : "");
+         break;
+
+      default:
+         printf("%c  event %u, 0x%02X", 'A' + servo, event, bytes[1]);
+         break;
+   }
+
+   putchar('\n');
+   atLineStart = 1;
+}
+
+int main(int argc, char* argv[])
+{
+   FILE* in = stdin;
+   UINT8 record[TRACE_RECORD_SIZE];
+   int length = 0;
+   int ch;
+   int arg = 1;
+
+   if(arg < argc && strcmp(argv[arg], "-q") == 0)
+   {
+      quiet = 1;
+      arg++;
+   }
+   if(arg < argc)
+   {
+      in = fopen(argv[arg], "rb");
+      if(in == 0)
+      {
+         perror(argv[arg]);
+         return 1;
+      }
+   }
+
+   while((ch = getc(in)) != EOF)
+   {
+      if(length > 0)
+      {
+         record[length++] = (UINT8)ch;
+         if(length == TRACE_RECORD_SIZE)
+         {
+            printRecord(record);
+            length = 0;
+         }
+      }
+      else if(ch & TRACE_SYNC)
+      {
+         record[length++] = (UINT8)ch;
+      }
+      else if(ch == UPLOAD_ACK || ch == UPLOAD_NAK)
+      {
+         if(!atLineStart)
+         {
+            putchar('\n');
+         }
+         printf("# %10.3f ms     %s\n", now / COUNTS_PER_MS,
+                ch == UPLOAD_ACK ? "ACK" : "NAK");
+         atLineStart = 1;
+      }
+      else if(!quiet)
+      {
+         putchar(ch);
+         atLineStart = (ch == '\n' || ch == '\r');
+      }
+   }
+
+   if(in != stdin)
+   {
+      fclose(in);
+   }
+
+   return 0;
+}
@@ -0,0 +1,160 @@
+/******************************************************************************
+ * timerwheel.c
+ *
+ * Description:
+ *
+ * Hierarchical timing wheel, see timerwheel.h.  A timer due in fewer than
+ * WHEEL_SLOTS ticks goes straight into its level 0 slot, where everything
+ * expires on the same tick.  A later one waits in level 1 until level 0
+ * has turned round to its last WHEEL_SLOTS ticks and is then moved down.
+ *
+ *****************************************************************************/
+
+// project includes
+#include "types.h"
+#include "timerwheel.h"
+
+static void wheelInsert(struct TimerWheel* wheel, struct WheelTimer* timer);
+
+
+// Empties the wheel and starts it at tick 0.
+//--------------------------------------------------------------
+void wheelInit(struct TimerWheel* wheel)
+{
+   UINT8 index;
+
+   wheel->now = 0;
+   for(index = 0; index < WHEEL_SLOTS; index++)
+   {
+      wheel->slots[0][index] = 0;
+      wheel->slots[1][index] = 0;
+   }
+}
+
+//*****************************************************************************
+// Starts a timer, stopping it first if it is already pending.
+//
+// Parameters:  wheel          The wheel to put the timer on.
+//              timer          The timer.
+//              ticks          Ticks from now it expires, 1 to WHEEL_MAX_TICKS.
+//                             Longer timers are cut to WHEEL_MAX_TICKS.
+//
+// Return: None.
+//*****************************************************************************
+void wheelAdd(struct TimerWheel* wheel, struct WheelTimer* timer, UINT16 ticks)
+{
+   wheelRemove(timer);
+
+   if(ticks == 0)
+   {
+      ticks = 1;
+   }
+   else if(ticks > WHEEL_MAX_TICKS)
+   {
+      ticks = WHEEL_MAX_TICKS;
+   }
+
+   timer->expires = wheel->now + ticks;
+   wheelInsert(wheel, timer);
+}
+
+// Stops a timer.  Does nothing if it is not pending.
+//--------------------------------------------------------------
+void wheelRemove(struct WheelTimer* timer)
+{
+   if(timer->slot == 0)
+   {
+      return;
+   }
+
+   if(timer->prev != 0)
+   {
+      timer->prev->next = timer->next;
+   }
+   else
+   {
+      *timer->slot = timer->next;
+   }
+   if(timer->next != 0)
+   {
+      timer->next->prev = timer->prev;
+   }
+
+   timer->slot = 0;
+}
+
+// Ticks until a pending timer expires.
+//--------------------------------------------------------------
+UINT16 wheelRemaining(const struct TimerWheel* wheel, const struct WheelTimer* timer)
+{
+   return (UINT16)(timer->expires - wheel->now);
+}
+
+//*****************************************************************************
+// Moves the wheel on one tick.
+//
+// Parameters:  wheel          The wheel.
+//
+// Return: The timers that expired on this tick, linked through next and
+//         no longer pending, or 0 if none did.  They can be started again
+//         straight away once the caller has read next.
+//*****************************************************************************
+struct WheelTimer* wheelTick(struct TimerWheel* wheel)
+{
+   struct WheelTimer* timer;
+   struct WheelTimer* expired;
+   struct WheelTimer** slot;
+
+   wheel->now++;
+
+   // Level 0 has gone round, bring down the timers of its next turn.
+   if((wheel->now & WHEEL_MASK) == 0)
+   {
+      slot = &wheel->slots[1][(wheel->now >> WHEEL_BITS) & WHEEL_MASK];
+      timer = *slot;
+      *slot = 0;
+
+      while(timer != 0)
+      {
+         expired = timer->next;
+         wheelInsert(wheel, timer);
+         timer = expired;
+      }
+   }
+
+   slot = &wheel->slots[0][wheel->now & WHEEL_MASK];
+   expired = *slot;
+   *slot = 0;
+
+   for(timer = expired; timer != 0; timer = timer->next)
+   {
+      timer->slot = 0;
+   }
+
+   return expired;
+}
+
+// Links a timer into the slot for its expiry tick.
+//--------------------------------------------------------------
+static void wheelInsert(struct TimerWheel* wheel, struct WheelTimer* timer)
+{
+   struct WheelTimer** slot;
+
+   if((UINT16)(timer->expires - wheel->now) < WHEEL_SLOTS)
+   {
+      slot = &wheel->slots[0][timer->expires & WHEEL_MASK];
+   }
+   else
+   {
+      slot = &wheel->slots[1][(timer->expires >> WHEEL_BITS) & WHEEL_MASK];
+   }
+
+   timer->slot = slot;
+   timer->prev = 0;
+   timer->next = *slot;
+   if(*slot != 0)
+   {
+      (*slot)->prev = timer;
+   }
+   *slot = timer;
+}
@@ -0,0 +1,49 @@
+/******************************************************************************
+ * timerwheel.h
+ *
+ * Description:
+ *
+ * Hierarchical timing wheel for timers counted in ticks.  Level 0 has a
+ * slot for each of the next WHEEL_SLOTS ticks and level 1 a slot for each
+ * of the next WHEEL_SLOTS turns of level 0.  wheelTick only looks at the
+ * slot of the tick it moves to, plus the level 1 slot it cascades down
+ * once per turn, so a tick costs O(expired) however many timers are
+ * pending.  Timers are doubly linked so stopping one is O(1) too.
+ *
+ *****************************************************************************/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "types.h"
+
+#define WHEEL_BITS      5
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+
+// Longest timer, in ticks, the two levels can hold.
+#define WHEEL_MAX_TICKS ((UINT16)WHEEL_SLOTS * WHEEL_SLOTS)
+
+// One timer.  Embed it in whatever it times and point owner back at that.
+struct WheelTimer
+{
+   struct WheelTimer* next;
+   struct WheelTimer* prev;
+   struct WheelTimer** slot;    // the slot list it is on, 0 if not pending
+   UINT16 expires;              // tick it expires on
+   void* owner;
+};
+
+struct TimerWheel
+{
+   UINT16 now;                  // ticks so far
+   struct WheelTimer* slots[2][WHEEL_SLOTS];
+};
+
+void wheelInit(struct TimerWheel* wheel);
+void wheelAdd(struct TimerWheel* wheel, struct WheelTimer* timer, UINT16 ticks);
+void wheelRemove(struct WheelTimer* timer);
+UINT16 wheelRemaining(const struct TimerWheel* wheel, const struct WheelTimer* timer);
+struct WheelTimer* wheelTick(struct TimerWheel* wheel);
+
+#endif // TIMERWHEEL_H
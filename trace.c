@@ -0,0 +1,110 @@
+/******************************************************************************
+ * trace.c
+ *
+ * Description:
+ *
+ * Binary event trace, see trace.h.  traceEvent and traceFlush are both
+ * called from the main loop only, so traceEvent is the only writer of
+ * traceHead and, while streaming, traceFlush the only writer of
+ * traceTail and the ring needs no locking.
+ *
+ *****************************************************************************/
+
+// project includes
+#include "types.h"
+#include "hal.h"
+#include "sci.h"
+#include "trace.h"
+
+#define TRACE_MASK  ((UINT8)(TRACE_BUFFER_SIZE - 1))
+
+UINT8 traceStreaming = TRUE;
+
+static struct TraceRecord traceBuffer[TRACE_BUFFER_SIZE];
+static UINT8 traceHead = 0;      // next free record, written by traceEvent
+static UINT8 traceTail = 0;      // next record to send, written by traceFlush
+static UINT8 traceLost = 0;      // records dropped since the last one sent
+
+
+//*****************************************************************************
+// Stores one record in the ring.  When the ring is full the new record is
+// dropped and counted while streaming, so the decoder can tell, and the
+// oldest one makes way for it while not.
+//
+// Parameters:  event          enum TRACEEVENT
+//              servo          the servo, 0 for A to 7 for H
+//              argument       what the event needs to say
+//
+// Return: None.
+//*****************************************************************************
+void traceEvent(UINT8 event, UINT8 servo, UINT8 argument)
+{
+   struct TraceRecord* record = &traceBuffer[traceHead];
+   UINT8 next = (UINT8)((traceHead + 1) & TRACE_MASK);
+
+   if(next == traceTail)
+   {
+      if(traceStreaming == TRUE)
+      {
+         if(traceLost != 0xFF)
+         {
+            traceLost++;
+         }
+         return;
+      }
+      traceTail = (UINT8)((traceTail + 1) & TRACE_MASK);
+   }
+
+   record->code = (UINT8)((event << 3) | servo);
+   record->argument = argument;
+   record->time = halTimerNow();
+   traceHead = next;
+}
+
+//*****************************************************************************
+// Moves as many whole records from the ring to the SCI0 transmit buffer
+// as there is room for, a TRACE_LOST record first if any were dropped.
+// Does nothing unless traceStreaming is TRUE.
+//
+// Parameters: NONE
+//
+// Return: None.
+//*****************************************************************************
+void traceFlush(void)
+{
+   struct TraceRecord* record;
+   UINT8 bytes[TRACE_RECORD_SIZE];
+
+   if(traceStreaming != TRUE)
+   {
+      return;
+   }
+
+   while(traceTail != traceHead)
+   {
+      record = &traceBuffer[traceTail];
+
+      bytes[2] = (UINT8)(record->time >> 8);
+      bytes[3] = (UINT8)record->time;
+
+      if(traceLost != 0)
+      {
+         bytes[0] = (UINT8)(TRACE_SYNC | (TRACE_LOST << 3));
+         bytes[1] = traceLost;
+         if(TryPutBytes(bytes, TRACE_RECORD_SIZE) == FALSE)
+         {
+            return;
+         }
+         traceLost = 0;
+      }
+
+      bytes[0] = (UINT8)(TRACE_SYNC | record->code);
+      bytes[1] = record->argument;
+      if(TryPutBytes(bytes, TRACE_RECORD_SIZE) == FALSE)
+      {
+         return;
+      }
+
+      traceTail = (UINT8)((traceTail + 1) & TRACE_MASK);
+   }
+}
@@ -0,0 +1,75 @@
+/******************************************************************************
+ * trace.h
+ *
+ * Description:
+ *
+ * Binary event trace.  traceEvent stores a four byte record (what
+ * happened, which servo, a TCNT timestamp and one byte of argument) in a
+ * RAM ring and returns, it never formats or sends anything, so the tasks
+ * can trace on every command without being slowed down.  traceFlush,
+ * called from the main loop, moves whole records into the SCI0 transmit
+ * buffer while there is room for them.  sim/tracedump.c turns the stream
+ * back into text on the host.
+ *
+ * On the wire a record is
+ *
+ *    byte 0   0x80 | event << 3 | servo
+ *    byte 1   argument
+ *    byte 2   timestamp, high byte
+ *    byte 3   timestamp, low byte
+ *
+ * where servo is the servo's letter, 0 for A to 7 for H, not the PWM
+ * channel that drives it; the two differ in the PWM_16BIT build.
+ *
+ * Everything else the firmware sends is 7 bit text, so byte 0 is the only
+ * byte with the top bit set that is not inside a record and the decoder
+ * can pick the records out of the terminal output.  The timestamp is TCNT,
+ * which counts at TIMER_CLK_FREQ (clock.h) and wraps every 87.381 ms; a
+ * TRACE_TICK record every tick lets the decoder unwrap it.
+ *
+ *****************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "types.h"
+
+// Records in the ring.  Must be a power of two no larger than 256.
+#define TRACE_BUFFER_SIZE  64
+
+// Bytes a record takes on the wire.
+#define TRACE_RECORD_SIZE  4
+
+// Marks byte 0 of a record on the wire.
+#define TRACE_SYNC         0x80
+
+// What a record is about, 0 to 15.
+enum TRACEEVENT
+{
+  TRACE_TICK = 0,               // runTasks ran a tick, argument: tick count
+  TRACE_COMMAND,                // processCommand, argument: the command byte,
+                                // for a fine MOV without its position
+  TRACE_READY,                  // updateTaskStatus finished a MOV or WAIT,
+                                // argument: the position reached in fine
+                                // steps, 255 if not known
+  TRACE_LOST,                   // records thrown away since the last one
+                                // that made it, argument: how many (up to 255)
+  TRACE_SWITCH                  // runNextCommand switched to the staged recipe
+};
+
+struct TraceRecord
+{
+   UINT8 code;                  // event << 3 | servo, 0 for A to 7 for H
+   UINT8 argument;
+   UINT16 time;                 // TCNT
+};
+
+// Send the ring out on SCI0.  TRUE by default; with FALSE the records
+// are kept in the ring, the oldest making way for the newest, for a
+// debugger to read.
+extern UINT8 traceStreaming;
+
+void traceEvent(UINT8 event, UINT8 servo, UINT8 argument);
+void traceFlush(void);
+
+#endif // TRACE_H
@@ -0,0 +1,152 @@
+/******************************************************************************
+ * upload.c
+ *
+ * Description:
+ *
+ * Recipe upload frame receiver, see upload.h.  uploadByte takes the
+ * frame in one byte at a time and keeps the command bytes in
+ * uploadRecipe until the checksum has been checked, so a bad frame
+ * never touches a recipe buffer.  What to do with a good frame is up to
+ * the caller.
+ *
+ *****************************************************************************/
+
+// project includes
+#include "types.h"
+#include "sci.h"
+#include "recipe.h"
+#include "upload.h"
+
+// Where in a frame the next byte goes.
+enum UPLOADSTATE
+{
+  WAIT_START = 0,
+  WAIT_SERVO,
+  WAIT_LENGTH,
+  WAIT_COMMANDS,
+  WAIT_CHECKSUM,
+  WAIT_IDLE                     // the rest of a frame with a bad length
+};
+
+UINT8 uploadServo = 0;
+UINT8 uploadLength = 0;
+UINT8 uploadRecipe[RECIPE_SIZE];
+
+static enum UPLOADSTATE uploadState = WAIT_START;
+static UINT8 uploadReceived = 0;   // command bytes so far
+static UINT8 uploadSum = 0;        // of every byte after UPLOAD_START
+static UINT8 uploadSeenTick = 0;   // tick uploadPoll last looked at
+static UINT8 uploadIdleTicks = 0;  // since the last byte, stops at 255
+
+
+//*****************************************************************************
+// Tells whether a frame has been started and not finished.
+//
+// Parameters: NONE
+//
+// Return: TRUE if the next byte received belongs to a frame.
+//*****************************************************************************
+UINT8 uploadReceiving(void)
+{
+   return (uploadState != WAIT_START) ? TRUE : FALSE;
+}
+
+//*****************************************************************************
+// Gives up on a frame that has had no byte for more than
+// UPLOAD_TIMEOUT_TICKS and answers it with UPLOAD_NAK, whether or not
+// another byte ever comes.  The rest of a frame with a bad length,
+// already answered, ends here too, once the line has gone quiet for as
+// long.  Called on every pass of the main loop, so the ticks are counted
+// as they go by and a frame that has stopped for longer than the tick
+// count takes to wrap is still given up.
+//
+// Parameters:  now            The OC1 tick count.
+//
+// Return: None.
+//*****************************************************************************
+void uploadPoll(UINT8 now)
+{
+   UINT8 elapsed = (UINT8)(now - uploadSeenTick);
+
+   uploadSeenTick = now;
+   if(uploadState == WAIT_START)
+   {
+      return;
+   }
+
+   uploadIdleTicks = (elapsed > 0xFF - uploadIdleTicks) ? 0xFF :
+                     (UINT8)(uploadIdleTicks + elapsed);
+   if(uploadIdleTicks > UPLOAD_TIMEOUT_TICKS)
+   {
+      // A frame with a bad length has had its UPLOAD_NAK already.
+      if(uploadState != WAIT_IDLE)
+      {
+         TERMIO_PutChar(UPLOAD_NAK);
+      }
+      uploadState = WAIT_START;
+   }
+}
+
+//*****************************************************************************
+// Takes the next byte of a frame.
+//
+// Parameters:  ch             The byte.  The first of a frame must be
+//                             UPLOAD_START, anything else is ignored.
+//              now            The OC1 tick count.
+//
+// Return: UPLOAD_FRAME once a frame has come in whole with a good
+//         checksum, UPLOAD_BAD once one has not, otherwise UPLOAD_MORE.
+//*****************************************************************************
+enum UPLOADRESULT uploadByte(UINT8 ch, UINT8 now)
+{
+   uploadSeenTick = now;
+   uploadIdleTicks = 0;
+   uploadSum = (UINT8)(uploadSum + ch);
+
+   switch(uploadState)
+   {
+      case WAIT_START:
+         if(ch == UPLOAD_START)
+         {
+            uploadSum = 0;
+            uploadState = WAIT_SERVO;
+         }
+         break;
+
+      case WAIT_SERVO:
+         uploadServo = ch;
+         uploadState = WAIT_LENGTH;
+         break;
+
+      case WAIT_LENGTH:
+         if(ch == 0 || ch > RECIPE_SIZE)
+         {
+            // Where the frame ends is not known, so everything up to the
+            // line going quiet is taken as part of it, not as keys.
+            uploadState = WAIT_IDLE;
+            return UPLOAD_BAD;
+         }
+         uploadLength = ch;
+         uploadReceived = 0;
+         uploadState = WAIT_COMMANDS;
+         break;
+
+      case WAIT_COMMANDS:
+         uploadRecipe[uploadReceived] = ch;
+         uploadReceived++;
+         if(uploadReceived == uploadLength)
+         {
+            uploadState = WAIT_CHECKSUM;
+         }
+         break;
+
+      case WAIT_IDLE:
+         break;
+
+      default:
+         uploadState = WAIT_START;
+         return (uploadSum == 0) ? UPLOAD_FRAME : UPLOAD_BAD;
+   }
+
+   return UPLOAD_MORE;
+}
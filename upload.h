@@ -0,0 +1,60 @@
+/******************************************************************************
+ * upload.h
+ *
+ * Description:
+ *
+ * Recipe upload over SCI0.  A host sends a new recipe for a paused servo
+ * as one binary frame:
+ *
+ *    UPLOAD_START  servo  length  length command bytes  checksum
+ *
+ * servo is 0 for servo A, 1 for B and so on, length is 1 to RECIPE_SIZE
+ * and checksum makes the servo, length, command and checksum bytes add
+ * up to 0 modulo 256.  Nothing is echoed while the frame comes in, the
+ * firmware answers the whole frame with one UPLOAD_ACK once the recipe
+ * is loaded or one UPLOAD_NAK if it was refused, so a host can send at
+ * full line rate.
+ *
+ * UPLOAD_START is a control character no operator command uses, so
+ * getUserInput can hand a frame to uploadByte and keep every other key
+ * for itself.  A frame that stops for longer than UPLOAD_TIMEOUT_TICKS
+ * is dropped with an UPLOAD_NAK by uploadPoll, called on every pass of
+ * the main loop, and the keys after it are keys again.  A frame with a
+ * length of 0 or past RECIPE_SIZE is answered with UPLOAD_NAK as soon as
+ * the length comes in, and every byte after it is thrown away until the
+ * line has been quiet for UPLOAD_TIMEOUT_TICKS, as there is no telling
+ * where the frame ends.
+ *
+ *****************************************************************************/
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include "types.h"
+#include "recipe.h"
+
+#define UPLOAD_START         0x02   // ASCII STX
+#define UPLOAD_ACK           0x06   // ASCII ACK
+#define UPLOAD_NAK           0x15   // ASCII NAK
+
+// Longest gap, in OC1 ticks, between two bytes of a frame.
+#define UPLOAD_TIMEOUT_TICKS 10
+
+// What uploadByte made of a byte.
+enum UPLOADRESULT
+{
+  UPLOAD_MORE = 0,              // part of a frame, more to come
+  UPLOAD_FRAME,                 // the last byte of a good frame
+  UPLOAD_BAD                    // the last byte of a frame that failed its checks
+};
+
+// The last good frame, valid once uploadByte returns UPLOAD_FRAME.
+extern UINT8 uploadServo;
+extern UINT8 uploadLength;
+extern UINT8 uploadRecipe[RECIPE_SIZE];
+
+UINT8 uploadReceiving(void);
+void uploadPoll(UINT8 now);
+enum UPLOADRESULT uploadByte(UINT8 ch, UINT8 now);
+
+#endif // UPLOAD_H